@@ -4,17 +4,108 @@
 #include <memory>
 #include <stdexcept>
 #include <iomanip>
-#define NOMINMAX
-#include <windows.h>
 #ifdef _WIN32
+#define NOMINMAX
 #include <windows.h>
 #endif
 #include <limits>
 #include <algorithm>
 #include <cctype>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <charconv>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <future>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+#ifdef HOTEL_HAVE_LIBNUMA
+#include <numa.h>
+#endif
 
 using namespace std;
 
+// ------------------- Подсчёт выделений памяти -------------------
+
+// При сборке с -DHOTEL_COUNT_ALLOCATIONS глобальный operator new считает
+// выделения памяти; используется замерами вставки (--bench insert).
+#ifdef HOTEL_COUNT_ALLOCATIONS
+atomic<size_t> gAllocationCount{ 0 };
+
+// Все формы new и delete сходятся в пару countedAlloc/countedFree, поэтому
+// malloc и free всегда парны, а компилятор не видит free на указателе из new.
+void* countedAlloc(size_t size) {
+    gAllocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void countedFree(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    countedFree(p);
+}
+#endif
+
+bool allocationCountingEnabled() {
+#ifdef HOTEL_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t allocationCount() {
+#ifdef HOTEL_COUNT_ALLOCATIONS
+    return gAllocationCount.load(memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
 // ------------------- Исключения -------------------
 
 class HotelException : public runtime_error {
@@ -45,22 +136,409 @@ public:
     }
 };
 
+class RoomNotFoundException : public HotelException {
+public:
+    explicit RoomNotFoundException(const string& msg)
+        : HotelException("Номер не найден: " + msg) {
+    }
+};
+
+// Синхронизация удалила бы слишком много номеров; ничего не изменено
+class MassRemovalException : public HotelException {
+public:
+    size_t count;
+
+    MassRemovalException(size_t count_, size_t total)
+        : HotelException("Массовое удаление: файл не содержит " + to_string(count_) + " из "
+            + to_string(total) + " номеров гостиницы"), count(count_) {
+    }
+};
+
+// ------------------- Пул потоков -------------------
+
+// Общий пул потоков с перехватом задач (work stealing) для массовых операций
+// над номерами. У каждого рабочего потока своя очередь: свои задачи он берёт
+// с конца, чужие перехватывает с начала. Поток, ожидающий завершения
+// parallelFor, сам выполняет задачи, поэтому вложенные и одновременные
+// массовые операции делят одни и те же потоки и не создают лишних.
+class WorkStealingPool {
+private:
+    struct Queue {
+        mutex m;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> threads;
+    atomic<bool> stopping{ false };
+    atomic<size_t> queued{ 0 };
+    atomic<size_t> nextQueue{ 0 };
+    mutex sleepMutex;
+    condition_variable wakeUp;
+
+    static int& currentWorker() {
+        static thread_local int id = -1;
+        return id;
+    }
+
+    bool popLocal(size_t q, function<void()>& task) {
+        lock_guard<mutex> lock(queues[q]->m);
+        if (queues[q]->tasks.empty()) return false;
+        task = move(queues[q]->tasks.back());
+        queues[q]->tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t q, function<void()>& task) {
+        lock_guard<mutex> lock(queues[q]->m);
+        if (queues[q]->tasks.empty()) return false;
+        task = move(queues[q]->tasks.front());
+        queues[q]->tasks.pop_front();
+        return true;
+    }
+
+    bool findTask(function<void()>& task) {
+        int self = currentWorker();
+        if (self >= 0 && popLocal(static_cast<size_t>(self), task)) {
+            queued.fetch_sub(1);
+            return true;
+        }
+        size_t start = self >= 0 ? static_cast<size_t>(self) + 1 : 0;
+        for (size_t i = 0; i < queues.size(); ++i) {
+            size_t q = (start + i) % queues.size();
+            if (steal(q, task)) {
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(int id) {
+        currentWorker() = id;
+        function<void()> task;
+        while (true) {
+            if (findTask(task)) {
+                task();
+                continue;
+            }
+            unique_lock<mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this] { return stopping.load() || queued.load() > 0; });
+            if (stopping.load() && queued.load() == 0) return;
+        }
+    }
+
+    explicit WorkStealingPool(size_t threadCount) {
+        for (size_t i = 0; i < threadCount; ++i) {
+            queues.push_back(make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, static_cast<int>(i));
+        }
+    }
+
+public:
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping.store(true);
+        }
+        wakeUp.notify_all();
+        for (thread& t : threads) t.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    static WorkStealingPool& instance() {
+        static WorkStealingPool pool(max(1u, thread::hardware_concurrency()));
+        return pool;
+    }
+
+    size_t size() const {
+        return threads.size();
+    }
+
+    void submit(function<void()> task) {
+        int self = currentWorker();
+        size_t q = self >= 0 ? static_cast<size_t>(self) : nextQueue.fetch_add(1) % queues.size();
+        {
+            lock_guard<mutex> lock(queues[q]->m);
+            queues[q]->tasks.push_back(move(task));
+        }
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            queued.fetch_add(1);
+        }
+        wakeUp.notify_one();
+    }
+
+    // выполнять задачи пула, пока done() не вернёт true; когда задач нет,
+    // вызывается idle(), который должен недолго подождать продвижения
+    template <typename Done, typename Idle>
+    void helpUntil(Done done, Idle idle) {
+        function<void()> task;
+        while (!done()) {
+            if (findTask(task)) {
+                task();
+            }
+            else {
+                idle();
+            }
+        }
+    }
+};
+
+// Счётчик незавершённых отрезков parallelFor и первое исключение из них.
+// Ожидающий поток спит на условной переменной, а не крутится в yield.
+class ParallelForLatch {
+private:
+    mutex m;
+    condition_variable finished;
+    size_t remaining;
+    exception_ptr error;
+
+public:
+    explicit ParallelForLatch(size_t count)
+        : remaining(count)
+    {
+    }
+
+    void fail(exception_ptr e) {
+        lock_guard<mutex> lock(m);
+        if (!error) error = e;
+    }
+
+    void countDown(size_t n = 1) {
+        lock_guard<mutex> lock(m);
+        remaining -= n;
+        if (remaining == 0) finished.notify_all();
+    }
+
+    bool done() {
+        lock_guard<mutex> lock(m);
+        return remaining == 0;
+    }
+
+    // задачи без свободного потока могут появиться в любой момент,
+    // поэтому сон короткий и ожидающий снова пробует помочь пулу
+    void waitBriefly() {
+        unique_lock<mutex> lock(m);
+        finished.wait_for(lock, chrono::milliseconds(1), [this] { return remaining == 0; });
+    }
+
+    void rethrowIfFailed() {
+        if (error) rethrow_exception(error);
+    }
+};
+
+// body(from, to) для отрезков [begin, end) длиной не больше grain
+template <typename Body>
+void parallelFor(size_t begin, size_t end, size_t grain, Body body) {
+    if (end <= begin) return;
+    if (grain == 0) grain = 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+    if (chunks == 1) {
+        body(begin, end);
+        return;
+    }
+
+    // задачи ссылаются на body и latch в этом кадре стека, поэтому выход
+    // из функции (в том числе по исключению) только после всех отрезков
+    WorkStealingPool& pool = WorkStealingPool::instance();
+    ParallelForLatch latch(chunks - 1);
+    size_t c = 1;
+    try {
+        for (; c < chunks; ++c) {
+            size_t from = begin + c * grain;
+            size_t to = min(end, from + grain);
+            pool.submit([&body, &latch, from, to] {
+                try {
+                    body(from, to);
+                }
+                catch (...) {
+                    latch.fail(current_exception());
+                }
+                latch.countDown();
+            });
+        }
+        body(begin, min(end, begin + grain));
+    }
+    catch (...) {
+        latch.fail(current_exception());
+        if (c < chunks) latch.countDown(chunks - c);
+    }
+    pool.helpUntil([&] { return latch.done(); }, [&] { latch.waitBriefly(); });
+    latch.rethrowIfFailed();
+}
+
+// map(from, to) даёт частичный результат отрезка, частичные результаты
+// объединяются combine по порядку отрезков, поэтому результат детерминирован
+template <typename T, typename Map, typename Combine>
+T parallelReduce(size_t begin, size_t end, size_t grain, T identity, Map map, Combine combine) {
+    if (end <= begin) return identity;
+    if (grain == 0) grain = 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+    vector<T> partial(chunks, identity);
+    parallelFor(0, chunks, 1, [&](size_t from, size_t to) {
+        for (size_t c = from; c < to; ++c) {
+            size_t lo = begin + c * grain;
+            partial[c] = map(lo, min(end, lo + grain));
+        }
+    });
+    T result = identity;
+    for (const T& p : partial) {
+        result = combine(result, p);
+    }
+    return result;
+}
+
+// Одна частичная структура T на поток: [begin, end) делится на столько
+// непрерывных отрезков (не короче minGrain), сколько потоков может их
+// выполнять, accumulate(part, from, to) заполняет структуру своего отрезка,
+// а mergeInto(result, move(part)) сливает их по порядку отрезков на месте,
+// без копий, поэтому результат детерминирован
+template <typename T, typename Accumulate, typename MergeInto>
+T parallelAccumulate(size_t begin, size_t end, size_t minGrain, Accumulate accumulate, MergeInto mergeInto) {
+    if (end <= begin) return T();
+    size_t workers = WorkStealingPool::instance().size() + 1;   // и вызывающий поток
+    size_t grain = max(max<size_t>(minGrain, 1), (end - begin + workers - 1) / workers);
+    size_t parts = (end - begin + grain - 1) / grain;
+    vector<T> partial(parts);
+    parallelFor(0, parts, 1, [&](size_t from, size_t to) {
+        for (size_t c = from; c < to; ++c) {
+            size_t lo = begin + c * grain;
+            accumulate(partial[c], lo, min(end, lo + grain));
+        }
+    });
+    T result = move(partial[0]);
+    for (size_t c = 1; c < parts; ++c) {
+        mergeInto(result, move(partial[c]));
+    }
+    return result;
+}
+
+// размер отрезка массовых операций над столбцами номеров
+const size_t kBulkGrain = 4096;
+
 // ------------------- Стратегии скидки -------------------
 
+class IDiscountStrategy;
+
+// Ключ группировки стратегий в аналитике: стратегии одного вида с одинаковым
+// параметром попадают в одну группу, даже если это разные объекты.
+// sample - любой объект группы, по нему строится описание; в сравнении не участвует.
+struct StrategyGroupKey {
+    uint32_t kind = 0;
+    uint64_t parameter = 0;
+    const IDiscountStrategy* sample = nullptr;
+
+    bool operator==(const StrategyGroupKey& other) const {
+        return kind == other.kind && parameter == other.parameter;
+    }
+};
+
+namespace std {
+template <>
+struct hash<StrategyGroupKey> {
+    size_t operator()(const StrategyGroupKey& key) const {
+        return hash<uint64_t>()(key.parameter * 0x9E3779B97F4A7C15ULL + key.kind);
+    }
+};
+}
+
+uint64_t doubleBits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Перемешивание 64-битного ключа (splitmix64) для фильтров и скетчей
+uint64_t mixHash(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
 class IDiscountStrategy {
 public:
     virtual ~IDiscountStrategy() = default;
     // возвращает итоговую стоимость при заданной базовой цене
     virtual double computeCost(double baseCost) const = 0;
+    // краткое описание для отчётов и аналитики
+    virtual string describe() const = 0;
+    // по умолчанию каждый объект стратегии - отдельная группа
+    virtual StrategyGroupKey groupKey() const {
+        return { 0, reinterpret_cast<uintptr_t>(this), this };
+    }
 };
 
+string formatPercent(double percent) {
+    ostringstream out;
+    out << percent << '%';
+    return out.str();
+}
+
 class NoDiscountStrategy : public IDiscountStrategy {
 public:
     double computeCost(double baseCost) const override {
         return baseCost;
     }
+
+    string describe() const override {
+        return "без скидки";
+    }
+
+    StrategyGroupKey groupKey() const override {
+        return { 1, 0, this };
+    }
+};
+
+// Итоговая стоимость задана явно (номера, восстановленные из снимка или реплики)
+class FixedCostStrategy : public IDiscountStrategy {
+private:
+    double finalCost;
+public:
+    explicit FixedCostStrategy(double finalCost_)
+        : finalCost(finalCost_) {
+    }
+
+    double computeCost(double) const override {
+        return finalCost;
+    }
+
+    string describe() const override {
+        return "фиксированная цена";
+    }
+
+    StrategyGroupKey groupKey() const override {
+        return { 2, 0, this };
+    }
 };
 
+// Проверки значений доступны на этапе компиляции: для таблиц, зашитых в
+// программу, неверное значение - ошибка сборки, а не исключение при запуске.
+constexpr bool isValidDiscountPercent(double percent) {
+    return percent >= 0.0 && percent < 100.0;
+}
+
+constexpr bool isValidBaseCost(double baseCost) {
+    return baseCost > 0.0;
+}
+
+constexpr double discountFactor(double percent) {
+    return 1.0 - percent / 100.0;
+}
+
+// Процент скидки, восстановленный по базовой и итоговой стоимости. Деление
+// даёт шум в последних разрядах (5% превращается в 5.000000000000004 и
+// попадает не в ту корзину отчёта), поэтому результат округляется до
+// миллионных долей процента.
+double discountPercentOf(double baseCost, double finalCost) {
+    return round((1.0 - finalCost / baseCost) * 100.0 * 1e6) / 1e6;
+}
+
 class PercentageDiscountStrategy : public IDiscountStrategy {
 private:
     double discountPercent; // >=0 и <100
@@ -68,129 +546,5030 @@ public:
     explicit PercentageDiscountStrategy(double percent)
         : discountPercent(percent)
     {
-        if (discountPercent < 0.0) {
-            throw InvalidValueException("процент скидки должен быть >= 0");
-        }
-        if (discountPercent >= 100.0) {
-            throw InvalidValueException("процент скидки должен быть < 100");
+        if (!isValidDiscountPercent(discountPercent)) {
+            throw InvalidValueException("процент скидки должен быть >= 0 и < 100");
         }
     }
 
     double computeCost(double baseCost) const override {
-        return baseCost * (1.0 - discountPercent / 100.0);
+        return baseCost * discountFactor(discountPercent);
+    }
+
+    string describe() const override {
+        return "скидка " + formatPercent(discountPercent);
+    }
+
+    StrategyGroupKey groupKey() const override {
+        return { 3, doubleBits(discountPercent), this };
     }
 };
 
-// ------------------- Интерфейс номера и реализация -------------------
+// ------------------- Стандартные тарифы -------------------
 
-class IRoom {
-public:
-    virtual ~IRoom() = default;
-    virtual string getNumber() const = 0;
-    virtual double getBaseCost() const = 0;
-    virtual double getFinalCost() const = 0;
+// Уровень скидки, проверяемый при constexpr-конструировании
+struct DiscountTier {
+    const char* name;
+    double percent;
+
+    constexpr DiscountTier(const char* name_, double percent_)
+        : name(name_),
+        percent(isValidDiscountPercent(percent_) ? percent_ : throw InvalidValueException("неверный процент уровня скидки")) {
+    }
 };
 
-class RoomBase : public IRoom {
-private:
-    string number;
+// Класс номера по умолчанию: базовая стоимость и индекс уровня скидки
+struct RoomClassDefaults {
+    const char* name;
     double baseCost;
-    shared_ptr<IDiscountStrategy> discountStrategy;
+    int tierIndex;
 
-public:
-    RoomBase(const string& number_, double baseCost_, shared_ptr<IDiscountStrategy> strategy_)
-        : number(number_), baseCost(baseCost_), discountStrategy(strategy_)
-    {
-        if (number.empty()) {
-            throw InvalidValueException("номер комнаты не может быть пустым");
-        }
-        if (baseCost <= 0.0) {
-            throw InvalidValueException("базовая стоимость должна быть > 0");
-        }
-        if (!discountStrategy) {
-            throw InvalidValueException("стратегия скидки не может быть null");
-        }
+    constexpr RoomClassDefaults(const char* name_, double baseCost_, int tierIndex_)
+        : name(name_),
+        baseCost(isValidBaseCost(baseCost_) ? baseCost_ : throw InvalidValueException("неверная стоимость класса номера")),
+        tierIndex(tierIndex_) {
     }
+};
 
-    string getNumber() const override {
-        return number;
+constexpr DiscountTier kStandardDiscountTiers[] = {
+    { "без скидки", 0.0 },
+    { "постоянный гость", 5.0 },
+    { "раннее бронирование", 10.0 },
+    { "длительное проживание", 15.0 },
+    { "корпоративный", 20.0 },
+};
+
+constexpr int kStandardDiscountTierCount = sizeof(kStandardDiscountTiers) / sizeof(kStandardDiscountTiers[0]);
+
+constexpr RoomClassDefaults kDefaultRoomClasses[] = {
+    { "standard", 3000.0, 0 },
+    { "comfort", 4500.0, 1 },
+    { "lux", 8000.0, 2 },
+};
+
+constexpr bool roomClassesReferValidTiers() {
+    for (const RoomClassDefaults& c : kDefaultRoomClasses) {
+        if (c.tierIndex < 0 || c.tierIndex >= kStandardDiscountTierCount) return false;
     }
+    return true;
+}
 
-    double getBaseCost() const override {
-        return baseCost;
+static_assert(roomClassesReferValidTiers(), "класс номера ссылается на несуществующий уровень скидки");
+
+// Скидка стандартного уровня: множитель - константа времени компиляции
+template <int TierIndex>
+class TierDiscountStrategy : public IDiscountStrategy {
+private:
+    static constexpr double kFactor = discountFactor(kStandardDiscountTiers[TierIndex].percent);
+public:
+    double computeCost(double baseCost) const override {
+        return baseCost * kFactor;
     }
 
-    double getFinalCost() const override {
-        return discountStrategy->computeCost(baseCost);
+    string describe() const override {
+        return string("уровень \"") + kStandardDiscountTiers[TierIndex].name + "\" (" +
+            formatPercent(kStandardDiscountTiers[TierIndex].percent) + ")";
+    }
+
+    StrategyGroupKey groupKey() const override {
+        return { 4, static_cast<uint64_t>(TierIndex), this };
     }
 };
 
-// ------------------- Класс гостиницы -------------------
+// Общие экземпляры стратегий стандартных уровней
+template <int TierIndex>
+shared_ptr<IDiscountStrategy> tierStrategy() {
+    static shared_ptr<IDiscountStrategy> instance = make_shared<TierDiscountStrategy<TierIndex>>();
+    return instance;
+}
 
-class Hotel {
+// Стратегия для процента: стандартные уровни возвращают общий экземпляр с
+// константным множителем, остальные проценты - PercentageDiscountStrategy
+shared_ptr<IDiscountStrategy> makeDiscountStrategy(double discountPercent) {
+    static_assert(kStandardDiscountTierCount == 5, "обновите список уровней ниже");
+    if (discountPercent == 0.0) {
+        static shared_ptr<IDiscountStrategy> none = make_shared<NoDiscountStrategy>();
+        return none;
+    }
+    if (discountPercent == kStandardDiscountTiers[1].percent) return tierStrategy<1>();
+    if (discountPercent == kStandardDiscountTiers[2].percent) return tierStrategy<2>();
+    if (discountPercent == kStandardDiscountTiers[3].percent) return tierStrategy<3>();
+    if (discountPercent == kStandardDiscountTiers[4].percent) return tierStrategy<4>();
+    return make_shared<PercentageDiscountStrategy>(discountPercent);
+}
+
+// ------------------- Правила скидок -------------------
+
+// Параметры проживания, по которым срабатывают правила
+struct StayParams {
+    int nights = 1;     // количество ночей
+    int daysAhead = 0;  // за сколько дней до заезда сделано бронирование
+};
+
+// Таблица правил скидок, скомпилированная в плоские столбцы.
+// Формат файла (одно правило в строке):
+//   <тип номера или *> <мин. ночей> <мин. дней до заезда> <процент>
+// Пустые строки и строки, начинающиеся с '#', пропускаются.
+// Правила хранятся по убыванию процента, поэтому первое подходящее
+// правило даёт наибольшую скидку, и просмотр на нём заканчивается.
+class DiscountRuleTable {
 private:
-    vector<shared_ptr<IRoom>> rooms;
+    vector<string> typeNames;      // словарь типов номеров, id = индекс
+    vector<int> ruleType;          // id типа, -1 - любой тип
+    vector<int> ruleMinNights;
+    vector<int> ruleMinDaysAhead;
+    vector<double> rulePercent;
 
-    bool existsRoomNumber(const string& num) const {
-        for (const auto& r : rooms) {
-            if (r->getNumber() == num) return true;
+    int findTypeId(const string& roomType) const {
+        for (size_t i = 0; i < typeNames.size(); ++i) {
+            if (typeNames[i] == roomType) return static_cast<int>(i);
         }
-        return false;
+        return -1;
     }
 
 public:
-    Hotel() = default;
-
-    // Добавить комнату: number (строка), базовая стоимость, скидка в процентах (0 - без скидки)
-    void addRoom(const string& number, double baseCost, double discountPercent = 0.0) {
-        if (number.size() > 50) {
-            cerr << "Предупреждение: обозначение номера слишком длинное\n";
+    void addRule(const string& roomType, int minNights, int minDaysAhead, double percent) {
+        if (roomType.empty()) {
+            throw InvalidValueException("тип номера в правиле не может быть пустым");
+        }
+        if (minNights < 0 || minDaysAhead < 0) {
+            throw InvalidValueException("условия правила не могут быть отрицательными");
+        }
+        if (!isValidDiscountPercent(percent)) {
+            throw InvalidValueException("процент скидки в правиле должен быть в [0, 100)");
         }
 
-        if (existsRoomNumber(number)) {
-            throw DuplicateRoomException("номер '" + number + "' уже существует");
+        int typeId = -1;
+        if (roomType != "*") {
+            typeId = findTypeId(roomType);
+            if (typeId < 0) {
+                typeNames.push_back(roomType);
+                typeId = static_cast<int>(typeNames.size() - 1);
+            }
         }
 
+        // вставка с сохранением порядка по убыванию процента
+        size_t pos = 0;
+        while (pos < rulePercent.size() && rulePercent[pos] >= percent) ++pos;
+        ruleType.insert(ruleType.begin() + pos, typeId);
+        ruleMinNights.insert(ruleMinNights.begin() + pos, minNights);
+        ruleMinDaysAhead.insert(ruleMinDaysAhead.begin() + pos, minDaysAhead);
+        rulePercent.insert(rulePercent.begin() + pos, percent);
+    }
 
-        shared_ptr<IDiscountStrategy> strat;
-        if (discountPercent == 0.0) {
-            strat = make_shared<NoDiscountStrategy>();
+    static DiscountRuleTable loadFromFile(const string& path) {
+        ifstream in(path);
+        if (!in) {
+            throw HotelException("не удалось открыть файл правил '" + path + "'");
         }
-        else {
-            strat = make_shared<PercentageDiscountStrategy>(discountPercent);
+        DiscountRuleTable table;
+        string line;
+        int lineNo = 0;
+        while (getline(in, line)) {
+            ++lineNo;
+            size_t start = line.find_first_not_of(" \t\r\n");
+            if (start == string::npos || line[start] == '#') continue;
+
+            istringstream ss(line);
+            string type;
+            int minNights = 0;
+            int minDaysAhead = 0;
+            double percent = 0.0;
+            if (!(ss >> type >> minNights >> minDaysAhead >> percent)) {
+                throw InvalidValueException("строка " + to_string(lineNo) + " файла правил имеет неверный формат");
+            }
+            table.addRule(type, minNights, minDaysAhead, percent);
         }
+        return table;
+    }
 
-        auto room = make_shared<RoomBase>(number, baseCost, strat);
-        rooms.push_back(room);
+    // процент скидки для номера данного типа при данных условиях (0 - нет подходящего правила)
+    double findPercent(const string& roomType, const StayParams& stay) const {
+        int typeId = findTypeId(roomType);
+        for (size_t i = 0; i < rulePercent.size(); ++i) {
+            if ((ruleType[i] < 0 || ruleType[i] == typeId) &&
+                stay.nights >= ruleMinNights[i] &&
+                stay.daysAhead >= ruleMinDaysAhead[i]) {
+                return rulePercent[i];
+            }
+        }
+        return 0.0;
     }
 
-    double calculateAverageCost() const {
-        if (rooms.empty()) {
-            throw EmptyRoomListException("нечего усреднять");
+    shared_ptr<IDiscountStrategy> makeStrategy(const string& roomType, const StayParams& stay) const {
+        return makeDiscountStrategy(findPercent(roomType, stay));
+    }
+
+    size_t size() const {
+        return rulePercent.size();
+    }
+};
+
+// ------------------- Формулы цен -------------------
+
+// Конечное число в начале [first, last), всегда с точкой (from_chars не
+// зависит от локали, которую устанавливает main); 0 - числа нет или оно
+// не помещается в double
+size_t parseLeadingNumber(const char* first, const char* last, double& value) {
+    auto parsed = from_chars(first, last, value);
+    if (parsed.ec != errc() || !isfinite(value)) return 0;
+    return static_cast<size_t>(parsed.ptr - first);
+}
+
+// Формула цены, разобранная один раз в регистровый байт-код.
+// Грамматика:
+//   expr    := term (('+' | '-') term)*
+//   term    := unary (('*' | '/') unary)*
+//   unary   := '-' unary | primary
+//   primary := число | base | min(expr, expr) | max(expr, expr) | '(' expr ')'
+// base - базовая стоимость номера. Пример: min(base * 0.9 + 200, 10000)
+class PricingFormula {
+public:
+    static const int kMaxRegisters = 16;
+
+private:
+    enum class Op : unsigned char { LoadConst, LoadBase, Add, Sub, Mul, Div, Neg, Min, Max };
+
+    struct Instr {
+        Op op;
+        unsigned char dst;
+        unsigned char a;
+        unsigned char b;
+        double imm;
+    };
+
+    string source;
+    vector<Instr> code;
+    int registersUsed = 0;
+
+    // состояние разбора
+    size_t pos = 0;
+
+    void skipSpaces() {
+        while (pos < source.size() && isspace(static_cast<unsigned char>(source[pos]))) ++pos;
+    }
+
+    bool accept(char c) {
+        skipSpaces();
+        if (pos < source.size() && source[pos] == c) {
+            ++pos;
+            return true;
         }
-        double sum = 0.0;
-        for (const auto& r : rooms) {
-            sum += r->getFinalCost();
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c)) {
+            throw InvalidValueException(string("в формуле ожидался символ '") + c + "' в позиции " + to_string(pos + 1));
         }
-        return sum / static_cast<double>(rooms.size());
     }
 
-    void printAll() const {
-        if (rooms.empty()) {
+    void emit(Op op, int dst, int a = 0, int b = 0, double imm = 0.0) {
+        if (dst >= kMaxRegisters) {
+            throw InvalidValueException("формула слишком сложная");
+        }
+        registersUsed = max(registersUsed, dst + 1);
+        code.push_back({ op, static_cast<unsigned char>(dst), static_cast<unsigned char>(a),
+                         static_cast<unsigned char>(b), imm });
+    }
+
+    // каждая функция разбора кладёт результат в регистр r и может портить регистры выше r
+    void parseExpr(int r) {
+        parseTerm(r);
+        while (true) {
+            if (accept('+')) {
+                parseTerm(r + 1);
+                emit(Op::Add, r, r, r + 1);
+            }
+            else if (accept('-')) {
+                parseTerm(r + 1);
+                emit(Op::Sub, r, r, r + 1);
+            }
+            else {
+                return;
+            }
+        }
+    }
+
+    void parseTerm(int r) {
+        parseUnary(r);
+        while (true) {
+            if (accept('*')) {
+                parseUnary(r + 1);
+                emit(Op::Mul, r, r, r + 1);
+            }
+            else if (accept('/')) {
+                parseUnary(r + 1);
+                emit(Op::Div, r, r, r + 1);
+            }
+            else {
+                return;
+            }
+        }
+    }
+
+    void parseUnary(int r) {
+        if (accept('-')) {
+            parseUnary(r);
+            emit(Op::Neg, r, r);
+            return;
+        }
+        parsePrimary(r);
+    }
+
+    void parsePrimary(int r) {
+        skipSpaces();
+        if (accept('(')) {
+            parseExpr(r);
+            expect(')');
+            return;
+        }
+        if (pos < source.size() && (isdigit(static_cast<unsigned char>(source[pos])) || source[pos] == '.')) {
+            double value = 0.0;
+            size_t used = parseLeadingNumber(source.data() + pos, source.data() + source.size(), value);
+            if (used == 0) {
+                throw InvalidValueException("неверное число в формуле в позиции " + to_string(pos + 1));
+            }
+            pos += used;
+            emit(Op::LoadConst, r, 0, 0, value);
+            return;
+        }
+
+        size_t start = pos;
+        while (pos < source.size() && isalpha(static_cast<unsigned char>(source[pos]))) ++pos;
+        string name = source.substr(start, pos - start);
+        if (name == "base") {
+            emit(Op::LoadBase, r);
+            return;
+        }
+        if (name == "min" || name == "max") {
+            expect('(');
+            parseExpr(r);
+            expect(',');
+            parseExpr(r + 1);
+            expect(')');
+            emit(name == "min" ? Op::Min : Op::Max, r, r, r + 1);
+            return;
+        }
+        if (name.empty()) {
+            throw InvalidValueException("неожиданный символ в формуле в позиции " + to_string(pos + 1));
+        }
+        throw InvalidValueException("неизвестное имя в формуле: '" + name + "'");
+    }
+
+    static double apply(Op op, double a, double b) {
+        switch (op) {
+        case Op::Add: return a + b;
+        case Op::Sub: return a - b;
+        case Op::Mul: return a * b;
+        case Op::Div: return a / b;
+        case Op::Neg: return -a;
+        case Op::Min: return a < b ? a : b;
+        case Op::Max: return a > b ? a : b;
+        default: return 0.0;
+        }
+    }
+
+public:
+    explicit PricingFormula(const string& text)
+        : source(text)
+    {
+        parseExpr(0);
+        skipSpaces();
+        if (pos != source.size()) {
+            throw InvalidValueException("лишние символы в формуле в позиции " + to_string(pos + 1));
+        }
+    }
+
+    const string& getSource() const {
+        return source;
+    }
+
+    double evaluate(double baseCost) const {
+        double regs[kMaxRegisters];
+        for (const Instr& in : code) {
+            switch (in.op) {
+            case Op::LoadConst: regs[in.dst] = in.imm; break;
+            case Op::LoadBase: regs[in.dst] = baseCost; break;
+            default: regs[in.dst] = apply(in.op, regs[in.a], regs[in.b]); break;
+            }
+        }
+        return regs[0];
+    }
+
+    // Пакетное вычисление по столбцу базовых стоимостей: каждая инструкция
+    // выполняется сразу для блока значений, поэтому разбор кода инструкции
+    // делается один раз на блок, а внутренние циклы простые и векторизуемые.
+    // Отрезки столбца обрабатываются параллельно в общем пуле.
+    void evaluateBatch(const vector<double>& baseCosts, vector<double>& out) const {
+        const size_t kBlock = 128;
+        out.resize(baseCosts.size());
+        parallelFor(0, baseCosts.size(), kBulkGrain, [&](size_t chunkBegin, size_t chunkEnd) {
+            double regs[kMaxRegisters][kBlock];
+            for (size_t from = chunkBegin; from < chunkEnd; from += kBlock) {
+                size_t n = min(kBlock, chunkEnd - from);
+                const double* base = baseCosts.data() + from;
+                for (const Instr& in : code) {
+                    double* d = regs[in.dst];
+                    const double* a = regs[in.a];
+                    const double* b = regs[in.b];
+                    switch (in.op) {
+                    case Op::LoadConst: for (size_t i = 0; i < n; ++i) d[i] = in.imm; break;
+                    case Op::LoadBase: for (size_t i = 0; i < n; ++i) d[i] = base[i]; break;
+                    case Op::Add: for (size_t i = 0; i < n; ++i) d[i] = a[i] + b[i]; break;
+                    case Op::Sub: for (size_t i = 0; i < n; ++i) d[i] = a[i] - b[i]; break;
+                    case Op::Mul: for (size_t i = 0; i < n; ++i) d[i] = a[i] * b[i]; break;
+                    case Op::Div: for (size_t i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+                    case Op::Neg: for (size_t i = 0; i < n; ++i) d[i] = -a[i]; break;
+                    case Op::Min: for (size_t i = 0; i < n; ++i) d[i] = a[i] < b[i] ? a[i] : b[i]; break;
+                    case Op::Max: for (size_t i = 0; i < n; ++i) d[i] = a[i] > b[i] ? a[i] : b[i]; break;
+                    }
+                }
+                copy(regs[0], regs[0] + n, out.begin() + from);
+            }
+        });
+    }
+};
+
+class FormulaDiscountStrategy : public IDiscountStrategy {
+private:
+    shared_ptr<const PricingFormula> formula;
+public:
+    explicit FormulaDiscountStrategy(shared_ptr<const PricingFormula> formula_)
+        : formula(formula_)
+    {
+        if (!formula) {
+            throw InvalidValueException("формула не может быть null");
+        }
+    }
+
+    double computeCost(double baseCost) const override {
+        return formula->evaluate(baseCost);
+    }
+
+    string describe() const override {
+        return "формула " + formula->getSource();
+    }
+
+    StrategyGroupKey groupKey() const override {
+        return { 5, reinterpret_cast<uintptr_t>(formula.get()), this };
+    }
+};
+
+// ------------------- Налоги и сборы -------------------
+
+// Конвейер налогов и сборов, начисляемых поверх итоговой стоимости.
+// Этапы применяются по порядку к накопленной сумме:
+//   процентный этап умножает сумму на (1 + процент / 100),
+//   фиксированный этап прибавляет к ней сумму сбора.
+// Формат файла: "percent <название> <процент>" или "fixed <название> <сумма>".
+class FeeSchedule {
+private:
+    vector<string> stageNames;
+    vector<bool> stageIsPercent;
+    vector<double> stageValues;
+
+public:
+    void addPercent(const string& name, double percent) {
+        if (percent < 0.0) {
+            throw InvalidValueException("процент налога не может быть отрицательным");
+        }
+        stageNames.push_back(name);
+        stageIsPercent.push_back(true);
+        stageValues.push_back(percent);
+    }
+
+    void addFixed(const string& name, double amount) {
+        if (amount < 0.0) {
+            throw InvalidValueException("сумма сбора не может быть отрицательной");
+        }
+        stageNames.push_back(name);
+        stageIsPercent.push_back(false);
+        stageValues.push_back(amount);
+    }
+
+    static FeeSchedule loadFromFile(const string& path) {
+        ifstream in(path);
+        if (!in) {
+            throw HotelException("не удалось открыть файл сборов '" + path + "'");
+        }
+        FeeSchedule schedule;
+        string line;
+        int lineNo = 0;
+        while (getline(in, line)) {
+            ++lineNo;
+            size_t start = line.find_first_not_of(" \t\r\n");
+            if (start == string::npos || line[start] == '#') continue;
+
+            istringstream ss(line);
+            string kind;
+            string name;
+            double value = 0.0;
+            if (!(ss >> kind >> name >> value) || (kind != "percent" && kind != "fixed")) {
+                throw InvalidValueException("строка " + to_string(lineNo) + " файла сборов имеет неверный формат");
+            }
+            if (kind == "percent") {
+                schedule.addPercent(name, value);
+            }
+            else {
+                schedule.addFixed(name, value);
+            }
+        }
+        return schedule;
+    }
+
+    bool empty() const {
+        return stageValues.empty();
+    }
+
+    double apply(double cost) const {
+        for (size_t s = 0; s < stageValues.size(); ++s) {
+            cost = stageIsPercent[s] ? cost * (1.0 + stageValues[s] / 100.0) : cost + stageValues[s];
+        }
+        return cost;
+    }
+
+    // пакетное применение: каждый этап проходит по отрезку столбца за один цикл,
+    // отрезки обрабатываются параллельно
+    void applyBatch(const vector<double>& costs, vector<double>& out) const {
+        out.assign(costs.begin(), costs.end());
+        parallelFor(0, out.size(), kBulkGrain, [&](size_t from, size_t to) {
+            for (size_t s = 0; s < stageValues.size(); ++s) {
+                if (stageIsPercent[s]) {
+                    double factor = 1.0 + stageValues[s] / 100.0;
+                    for (size_t i = from; i < to; ++i) out[i] *= factor;
+                }
+                else {
+                    double fee = stageValues[s];
+                    for (size_t i = from; i < to; ++i) out[i] += fee;
+                }
+            }
+        });
+    }
+};
+
+// ------------------- Интерфейс номера и реализация -------------------
+
+struct RoomType;
+
+class IRoom {
+public:
+    virtual ~IRoom() = default;
+    virtual const string& getNumber() const = 0;
+    virtual double getBaseCost() const = 0;
+    virtual double getFinalCost() const = 0;
+    // стратегия скидки номера, если она есть (для аналитики по стратегиям)
+    virtual const IDiscountStrategy* getDiscountStrategy() const {
+        return nullptr;
+    }
+    // тип номера из каталога, если номер на него ссылается
+    virtual const RoomType* getRoomType() const {
+        return nullptr;
+    }
+};
+
+class RoomBase : public IRoom {
+private:
+    string number;
+    double baseCost;
+    shared_ptr<IDiscountStrategy> discountStrategy;
+
+public:
+    RoomBase(string number_, double baseCost_, shared_ptr<IDiscountStrategy> strategy_)
+        : number(move(number_)), baseCost(baseCost_), discountStrategy(move(strategy_))
+    {
+        if (number.empty()) {
+            throw InvalidValueException("номер комнаты не может быть пустым");
+        }
+        if (!isValidBaseCost(baseCost)) {
+            throw InvalidValueException("базовая стоимость должна быть > 0");
+        }
+        if (!discountStrategy) {
+            throw InvalidValueException("стратегия скидки не может быть null");
+        }
+    }
+
+    const string& getNumber() const override {
+        return number;
+    }
+
+    double getBaseCost() const override {
+        return baseCost;
+    }
+
+    double getFinalCost() const override {
+        return discountStrategy->computeCost(baseCost);
+    }
+
+    const IDiscountStrategy* getDiscountStrategy() const override {
+        return discountStrategy.get();
+    }
+};
+
+// ------------------- Типы номеров -------------------
+
+// Тип номера (приспособленец): базовая стоимость и скидка хранятся один раз
+// для всех номеров типа. Изменение цены типа - O(1), номера читают её через
+// указатель на тип.
+struct RoomType {
+    uint32_t id = 0;
+    string name;
+    double baseCost = 0.0;
+    shared_ptr<IDiscountStrategy> strategy;
+    size_t roomCount = 0;     // номеров этого типа в гостинице
+};
+
+class RoomTypeCatalog {
+private:
+    deque<RoomType> types;    // deque: адреса типов не меняются при добавлении
+
+    static void validate(double baseCost, const shared_ptr<IDiscountStrategy>& strategy) {
+        if (!isValidBaseCost(baseCost)) {
+            throw InvalidValueException("базовая стоимость типа должна быть > 0");
+        }
+        if (!strategy) {
+            throw InvalidValueException("стратегия скидки не может быть null");
+        }
+    }
+
+public:
+    uint32_t define(const string& name, double baseCost, shared_ptr<IDiscountStrategy> strategy) {
+        if (name.empty()) {
+            throw InvalidValueException("название типа не может быть пустым");
+        }
+        if (find(name)) {
+            throw InvalidValueException("тип номера '" + name + "' уже существует");
+        }
+        validate(baseCost, strategy);
+        RoomType type;
+        type.id = static_cast<uint32_t>(types.size());
+        type.name = name;
+        type.baseCost = baseCost;
+        type.strategy = move(strategy);
+        types.push_back(move(type));
+        return types.back().id;
+    }
+
+    RoomType* find(const string& name) {
+        for (RoomType& t : types) {
+            if (t.name == name) return &t;
+        }
+        return nullptr;
+    }
+
+    RoomType& get(const string& name) {
+        RoomType* type = find(name);
+        if (!type) {
+            throw InvalidValueException("неизвестный тип номера '" + name + "'");
+        }
+        return *type;
+    }
+
+    const RoomType& get(uint32_t id) const {
+        if (id >= types.size()) {
+            throw InvalidValueException("неизвестный тип номера #" + to_string(id));
+        }
+        return types[id];
+    }
+
+    RoomType& get(uint32_t id) {
+        if (id >= types.size()) {
+            throw InvalidValueException("неизвестный тип номера #" + to_string(id));
+        }
+        return types[id];
+    }
+
+    void reprice(RoomType& type, double baseCost, shared_ptr<IDiscountStrategy> strategy) {
+        validate(baseCost, strategy);
+        type.baseCost = baseCost;
+        type.strategy = move(strategy);
+    }
+
+    size_t size() const {
+        return types.size();
+    }
+};
+
+// Номер, ссылающийся на тип. Собственные значения хранятся отдельно и
+// только если отличаются от типа.
+class TypedRoom : public IRoom {
+private:
+    struct Overrides {
+        double baseCost = NAN;                       // NaN - стоимость типа
+        shared_ptr<IDiscountStrategy> strategy;      // null - скидка типа
+    };
+
+    string number;
+    RoomType* type;
+    unique_ptr<Overrides> overrides;
+
+public:
+    TypedRoom(string number_, RoomType& type_)
+        : number(move(number_)), type(&type_)
+    {
+        if (number.empty()) {
+            throw InvalidValueException("номер комнаты не может быть пустым");
+        }
+        ++type->roomCount;
+    }
+
+    TypedRoom(string number_, RoomType& type_, double baseCost_, shared_ptr<IDiscountStrategy> strategy_)
+        : TypedRoom(move(number_), type_)
+    {
+        if (!isValidBaseCost(baseCost_)) {
+            throw InvalidValueException("базовая стоимость должна быть > 0");
+        }
+        if (!strategy_) {
+            throw InvalidValueException("стратегия скидки не может быть null");
+        }
+        bool ownCost = baseCost_ != type->baseCost;
+        bool ownStrategy = !(strategy_->groupKey() == type->strategy->groupKey());
+        if (ownCost || ownStrategy) {
+            overrides.reset(new Overrides());
+            if (ownCost) overrides->baseCost = baseCost_;
+            if (ownStrategy) overrides->strategy = move(strategy_);
+        }
+    }
+
+    TypedRoom(const TypedRoom&) = delete;
+    TypedRoom& operator=(const TypedRoom&) = delete;
+
+    ~TypedRoom() override {
+        --type->roomCount;
+    }
+
+    const string& getNumber() const override {
+        return number;
+    }
+
+    double getBaseCost() const override {
+        return overrides && !std::isnan(overrides->baseCost) ? overrides->baseCost : type->baseCost;
+    }
+
+    double getFinalCost() const override {
+        return getDiscountStrategy()->computeCost(getBaseCost());
+    }
+
+    const IDiscountStrategy* getDiscountStrategy() const override {
+        return overrides && overrides->strategy ? overrides->strategy.get() : type->strategy.get();
+    }
+
+    const RoomType* getRoomType() const override {
+        return type;
+    }
+};
+
+// ------------------- Журнал изменений (CDC) -------------------
+
+// TypeRepriced - одно событие на смену цены типа вместо события на каждый
+// его номер: number пуст, roomType - название типа, стоимости - новые
+// стоимости типа
+enum class RoomChangeKind : unsigned char { Added, Updated, Removed, TypeRepriced };
+
+struct RoomChangeEvent {
+    unsigned long long sequence = 0;   // номер события в потоке гостиницы
+    RoomChangeKind kind = RoomChangeKind::Added;
+    string number;
+    string roomType;                   // тип номера; пусто, если номер без типа
+    double baseCost = 0.0;             // для Removed - 0
+    double finalCost = 0.0;
+};
+
+// Кольцевой буфер событий с одним писателем (гостиница) и несколькими
+// подписчиками, у каждого из которых свой курсор чтения. Писатель никогда
+// не ждёт: каждое событие получает следующий номер и пишется поверх самых
+// старых ячеек. Ячейка - seqlock: её метка нечётна во время записи и равна
+// 2 * позиция + 2 после неё, поля хранятся атомарными словами прямо в ячейке.
+// Читатель сверяет метку до и после копирования и, если ячейку перезаписали,
+// идёт дальше. Номер и тип, не уместившиеся в одну ячейку, занимают
+// несколько подряд.
+// Подписчик, отставший больше чем на буфер, перескакивает к самому старому
+// уцелевшему событию; пропуск виден по номерам последовательности и
+// учитывается в getOverruns().
+class ChangeEventRing {
+public:
+    static const int kMaxSubscribers = 8;
+
+private:
+    static const size_t kDataWords = 10;
+    static const size_t kChunkBytes = kDataWords * sizeof(uint64_t);
+
+    // 128 байт: метка, заголовок, событие и кусок номера с типом
+    struct Slot {
+        atomic<uint64_t> stamp{ 0 };
+        atomic<uint64_t> meta{ 0 };        // вид | номер части << 8 | число частей << 32
+        atomic<uint64_t> sequence{ 0 };
+        atomic<uint64_t> baseBits{ 0 };
+        atomic<uint64_t> finalBits{ 0 };
+        atomic<uint64_t> length{ 0 };      // длина номера | длина типа << 32
+        atomic<uint64_t> data[kDataWords]; // номер, за ним тип
+    };
+
+    struct SlotCopy {
+        uint64_t meta;
+        uint64_t sequence;
+        uint64_t baseBits;
+        uint64_t finalBits;
+        uint64_t length;
+        uint64_t data[kDataWords];
+
+        size_t partIndex() const { return static_cast<size_t>((meta >> 8) & 0xFFFFFF); }
+        size_t partCount() const { return static_cast<size_t>(meta >> 32); }
+    };
+
+    struct Cursor {
+        string payload;                             // буфер чтения подписчика
+        atomic<bool> claimed{ false };
+        atomic<bool> active{ false };
+        atomic<unsigned long long> next{ 0 };       // позиция ячейки
+        atomic<unsigned long long> expected{ 0 };   // номер следующего события
+        atomic<unsigned long long> overruns{ 0 };
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t size;
+    unsigned long long mask;
+    atomic<unsigned long long> head{ 0 };     // ячеек записано
+    atomic<unsigned long long> events{ 0 };   // событий опубликовано
+    atomic<unsigned long long> dropped{ 0 };
+    Cursor cursors[kMaxSubscribers];
+
+    static uint64_t toBits(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static double fromBits(uint64_t bits) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    bool readSlot(unsigned long long position, SlotCopy& out) const {
+        const Slot& slot = slots[position & mask];
+        uint64_t stamp = slot.stamp.load(memory_order_acquire);
+        if (stamp != 2 * position + 2) return false;
+        out.meta = slot.meta.load(memory_order_relaxed);
+        out.sequence = slot.sequence.load(memory_order_relaxed);
+        out.baseBits = slot.baseBits.load(memory_order_relaxed);
+        out.finalBits = slot.finalBits.load(memory_order_relaxed);
+        out.length = slot.length.load(memory_order_relaxed);
+        for (size_t w = 0; w < kDataWords; ++w) {
+            out.data[w] = slot.data[w].load(memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        return slot.stamp.load(memory_order_relaxed) == stamp;
+    }
+
+    void skip(Cursor& c, unsigned long long count) {
+        c.overruns.fetch_add(count, memory_order_relaxed);
+        dropped.fetch_add(count, memory_order_relaxed);
+    }
+
+public:
+    // capacity (в ячейках) округляется вверх до степени двойки, не меньше 4
+    explicit ChangeEventRing(size_t capacity = 1024) {
+        size = 4;
+        while (size < capacity) size <<= 1;
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+    }
+
+    ChangeEventRing(const ChangeEventRing&) = delete;
+    ChangeEventRing& operator=(const ChangeEventRing&) = delete;
+
+    // номер последовательности расходуется всегда, даже если старые события
+    // в ячейках ещё не прочитаны кем-то из подписчиков. Событие занимает не
+    // больше половины буфера: более длинные номер и тип в журнале обрезаются.
+    void publish(RoomChangeKind kind, const string& number, const string& roomType,
+        double baseCost, double finalCost) {
+        size_t capacity = size / 2 * kChunkBytes;
+        size_t numberLength = min(number.size(), capacity);
+        size_t typeLength = min(roomType.size(), capacity - numberLength);
+        size_t length = numberLength + typeLength;
+        size_t parts = max<size_t>(1, (length + kChunkBytes - 1) / kChunkBytes);
+        string payload;
+        payload.reserve(length);
+        payload.append(number, 0, numberLength).append(roomType, 0, typeLength);
+        unsigned long long h = head.load(memory_order_relaxed);
+        unsigned long long sequence = events.load(memory_order_relaxed);
+
+        for (size_t p = 0; p < parts; ++p) {
+            unsigned long long position = h + p;
+            Slot& slot = slots[position & mask];
+            slot.stamp.store(2 * position + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            slot.meta.store(static_cast<uint64_t>(kind) | static_cast<uint64_t>(p) << 8 |
+                static_cast<uint64_t>(parts) << 32, memory_order_relaxed);
+            slot.sequence.store(sequence, memory_order_relaxed);
+            slot.baseBits.store(toBits(baseCost), memory_order_relaxed);
+            slot.finalBits.store(toBits(finalCost), memory_order_relaxed);
+            slot.length.store(static_cast<uint64_t>(numberLength) | static_cast<uint64_t>(typeLength) << 32,
+                memory_order_relaxed);
+            size_t from = p * kChunkBytes;
+            size_t chunk = from < length ? min(kChunkBytes, length - from) : 0;
+            uint64_t words[kDataWords] = {};
+            if (chunk > 0) memcpy(words, payload.data() + from, chunk);
+            for (size_t w = 0; w < kDataWords; ++w) {
+                slot.data[w].store(words[w], memory_order_relaxed);
+            }
+            slot.stamp.store(2 * position + 2, memory_order_release);
+        }
+        events.store(sequence + 1, memory_order_release);
+        head.store(h + parts, memory_order_release);
+    }
+
+    // возвращает id подписчика; чтение начинается с текущего конца потока.
+    // Вызывается из потока писателя
+    int subscribe() {
+        for (int i = 0; i < kMaxSubscribers; ++i) {
+            bool expected = false;
+            if (cursors[i].claimed.compare_exchange_strong(expected, true)) {
+                cursors[i].next.store(head.load(memory_order_acquire), memory_order_relaxed);
+                cursors[i].expected.store(events.load(memory_order_acquire), memory_order_relaxed);
+                cursors[i].overruns.store(0, memory_order_relaxed);
+                cursors[i].active.store(true, memory_order_release);
+                return i;
+            }
+        }
+        throw HotelException("превышено число подписчиков журнала изменений");
+    }
+
+    void unsubscribe(int id) {
+        cursors[id].active.store(false, memory_order_release);
+        cursors[id].claimed.store(false, memory_order_release);
+    }
+
+    // забрать следующее событие подписчика; false - новых событий нет.
+    // Если подписчик отстал и его события перезаписаны, возвращается самое
+    // старое уцелевшее событие: его sequence больше ожидаемого
+    bool poll(int id, RoomChangeEvent& out) {
+        Cursor& c = cursors[id];
+        unsigned long long n = c.next.load(memory_order_relaxed);
+        SlotCopy part;
+        while (true) {
+            unsigned long long h = head.load(memory_order_acquire);
+            if (n == h) {
+                c.next.store(n, memory_order_release);
+                return false;
+            }
+            if (h - n > size) n = h - size;
+            // ячейку уже перезаписали или это продолжение события, начало
+            // которого потеряно - переходим к следующей
+            if (!readSlot(n, part) || part.partIndex() != 0) {
+                ++n;
+                continue;
+            }
+            size_t parts = part.partCount();
+            size_t numberLength = static_cast<size_t>(part.length & 0xFFFFFFFF);
+            size_t length = numberLength + static_cast<size_t>(part.length >> 32);
+            unsigned long long sequence = part.sequence;
+            out.kind = static_cast<RoomChangeKind>(part.meta & 0xFF);
+            out.baseCost = fromBits(part.baseBits);
+            out.finalCost = fromBits(part.finalBits);
+            string& payload = c.payload;
+            payload.resize(length);
+            bool intact = true;
+            for (size_t p = 0; p < parts; ++p) {
+                if (p > 0 && (!readSlot(n + p, part) || part.sequence != sequence)) {
+                    intact = false;
+                    break;
+                }
+                size_t from = p * kChunkBytes;
+                if (from < length) memcpy(&payload[from], part.data, min(kChunkBytes, length - from));
+            }
+            if (!intact) {
+                ++n;
+                continue;
+            }
+            out.number.assign(payload, 0, numberLength);
+            out.roomType.assign(payload, numberLength, string::npos);
+            out.sequence = sequence;
+            unsigned long long expected = c.expected.load(memory_order_relaxed);
+            if (sequence > expected) skip(c, sequence - expected);
+            c.expected.store(sequence + 1, memory_order_relaxed);
+            c.next.store(n + parts, memory_order_release);
+            return true;
+        }
+    }
+
+    // номер следующего события
+    unsigned long long getHead() const {
+        return events.load(memory_order_acquire);
+    }
+
+    // сколько событий подписчики потеряли из-за отставания (всего и по курсору)
+    unsigned long long getDropped() const {
+        return dropped.load(memory_order_relaxed);
+    }
+
+    unsigned long long getOverruns(int id) const {
+        return cursors[id].overruns.load(memory_order_relaxed);
+    }
+
+    bool hasSubscribers() const {
+        for (const Cursor& c : cursors) {
+            if (c.active.load(memory_order_acquire)) return true;
+        }
+        return false;
+    }
+
+    // подписчик уже потерял события, но ещё не дошёл до пропуска
+    bool isLapped(int id) const {
+        return head.load(memory_order_acquire) - cursors[id].next.load(memory_order_acquire) > size;
+    }
+
+    // подписчик прочитал всё, что опубликовано к этому моменту
+    bool isCaughtUp(int id) const {
+        return cursors[id].next.load(memory_order_acquire) == head.load(memory_order_acquire);
+    }
+};
+
+const char* changeKindName(RoomChangeKind kind) {
+    switch (kind) {
+    case RoomChangeKind::Added: return "add";
+    case RoomChangeKind::Updated: return "update";
+    case RoomChangeKind::Removed: return "remove";
+    case RoomChangeKind::TypeRepriced: return "type-reprice";
+    }
+    return "?";
+}
+
+// Подписчик, который в фоновом потоке дописывает события в текстовый файл:
+// "<seq> <add|update|remove|type-reprice> <длина>:<номер> <длина>:<тип> <баз.стоимость> <итоговая стоимость>",
+// пустые номер (type-reprice) и тип (номер без типа) пишутся как "0:".
+// Если писатель отстал от буфера, перед следующим событием пишется строка
+// "# gap <первый потерянный> <первый уцелевший>".
+class ChangeLogFileWriter {
+private:
+    ChangeEventRing& ring;
+    int subscriberId;
+    unsigned long long expected;
+    ofstream out;
+    atomic<bool> stopping{ false };
+    thread worker;
+
+    void run() {
+        RoomChangeEvent e;
+        while (true) {
+            bool any = false;
+            while (ring.poll(subscriberId, e)) {
+                if (e.sequence != expected) {
+                    out << "# gap " << expected << ' ' << e.sequence << '\n';
+                }
+                expected = e.sequence + 1;
+                out << e.sequence << ' ' << changeKindName(e.kind) << ' '
+                    << e.number.size() << ':' << e.number << ' ' << e.roomType.size() << ':' << e.roomType << ' '
+                    << e.baseCost << ' ' << e.finalCost << '\n';
+                any = true;
+            }
+            if (any) {
+                out.flush();
+            }
+            else if (stopping.load(memory_order_acquire)) {
+                return;
+            }
+            else {
+                this_thread::sleep_for(chrono::milliseconds(5));
+            }
+        }
+    }
+
+public:
+    ChangeLogFileWriter(ChangeEventRing& ring_, const string& path)
+        : ring(ring_), subscriberId(-1), expected(0), out(path, ios::app)
+    {
+        if (!out) {
+            throw HotelException("не удалось открыть файл журнала '" + path + "'");
+        }
+        subscriberId = ring.subscribe();
+        expected = ring.getHead();
+        worker = thread(&ChangeLogFileWriter::run, this);
+    }
+
+    ~ChangeLogFileWriter() {
+        stopping.store(true, memory_order_release);
+        if (worker.joinable()) worker.join();
+        ring.unsubscribe(subscriberId);
+    }
+
+    ChangeLogFileWriter(const ChangeLogFileWriter&) = delete;
+    ChangeLogFileWriter& operator=(const ChangeLogFileWriter&) = delete;
+};
+
+// ------------------- Снимки состояния -------------------
+
+// Строка снимка: номер, базовая и итоговая стоимость.
+// Формат снимка (текстовый):
+//   HOTEL-SNAPSHOT 1 <номер следующего события> <количество строк>
+//   <длина номера>:<номер> <баз.стоимость> <итоговая стоимость>
+// Длина перед номером позволяет хранить номера с пробелами.
+struct SnapshotRow {
+    string number;
+    double baseCost = 0.0;
+    double finalCost = 0.0;
+};
+
+void writeSnapshotRow(ostream& out, const string& number, double baseCost, double finalCost) {
+    out << number.size() << ':' << number << ' ' << baseCost << ' ' << finalCost << '\n';
+}
+
+bool readSnapshotRow(istream& in, SnapshotRow& row) {
+    size_t length = 0;
+    char colon = 0;
+    if (!(in >> length) || !in.get(colon) || colon != ':') {
+        return false;
+    }
+    row.number.assign(length, '\0');
+    if (length > 0 && !in.read(&row.number[0], static_cast<streamsize>(length))) {
+        return false;
+    }
+    return static_cast<bool>(in >> row.baseCost >> row.finalCost);
+}
+
+void writeSnapshot(ostream& out, unsigned long long sequence, const vector<SnapshotRow>& rows) {
+    out << setprecision(17);
+    out << "HOTEL-SNAPSHOT 1 " << sequence << ' ' << rows.size() << '\n';
+    for (const SnapshotRow& row : rows) {
+        writeSnapshotRow(out, row.number, row.baseCost, row.finalCost);
+    }
+}
+
+vector<SnapshotRow> readSnapshot(istream& in, unsigned long long& sequence) {
+    string magic;
+    int formatVersion = 0;
+    size_t count = 0;
+    if (!(in >> magic >> formatVersion >> sequence >> count) || magic != "HOTEL-SNAPSHOT" || formatVersion != 1) {
+        throw HotelException("неверный формат снимка");
+    }
+    vector<SnapshotRow> rows(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!readSnapshotRow(in, rows[i])) {
+            throw HotelException("снимок повреждён в строке " + to_string(i + 1));
+        }
+    }
+    return rows;
+}
+
+// ------------------- Ленивые индексы -------------------
+
+// Отсортированный индекс (ключ, позиция номера), который строится в фоновом
+// потоке по копии ключей. Запросы никогда не ждут построения: пока индекс
+// не готов или устарел (версия гостиницы изменилась), tryGet возвращает
+// nullptr, и вызывающий код выполняет обычный просмотр.
+template <typename Key>
+class LazySortedIndex {
+public:
+    typedef vector<pair<Key, uint32_t>> Entries;
+
+private:
+    // Состояние одного построения. Поток построения владеет им вместе
+    // с индексом, поэтому устаревшее построение можно просто бросить:
+    // оно заметит отмену и завершится, никого не задерживая.
+    struct BuildJob {
+        atomic<bool> cancelled{ false };
+        atomic<bool> done{ false };
+        Entries result;
+    };
+
+    struct Cancelled {};
+
+    Entries entries;
+    unsigned long long builtVersion = ~0ULL;
+    shared_ptr<BuildJob> pending;
+    unsigned long long pendingVersion = ~0ULL;
+
+    static void build(shared_ptr<BuildJob> job, vector<Key> keys) {
+        const size_t kCheckEvery = 1 << 16;
+        try {
+            Entries result;
+            result.reserve(keys.size());
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (i % kCheckEvery == 0 && job->cancelled.load(memory_order_relaxed)) return;
+                result.emplace_back(move(keys[i]), static_cast<uint32_t>(i));
+            }
+            // сравнение изредка проверяет флаг отмены и прерывает сортировку
+            size_t comparisons = 0;
+            sort(result.begin(), result.end(), [&](const pair<Key, uint32_t>& a, const pair<Key, uint32_t>& b) {
+                if (++comparisons % kCheckEvery == 0 && job->cancelled.load(memory_order_relaxed)) {
+                    throw Cancelled();
+                }
+                return a < b;
+            });
+            job->result = move(result);
+            job->done.store(true, memory_order_release);
+        }
+        catch (const Cancelled&) {
+        }
+        catch (const bad_alloc&) {
+            // индекс необязателен: запросы продолжат обычный просмотр
+        }
+    }
+
+public:
+    ~LazySortedIndex() {
+        if (pending) pending->cancelled.store(true, memory_order_relaxed);
+    }
+
+    bool isBuilding() const {
+        return pending != nullptr;
+    }
+
+    // запустить построение, если для этой версии оно ещё не запущено;
+    // построение для старой версии отменяется без ожидания. Ключи
+    // копирует produceKeys, и только когда построение действительно нужно
+    template <typename ProduceKeys>
+    void startBuild(unsigned long long version, ProduceKeys produceKeys) {
+        if (builtVersion == version || (pending && pendingVersion == version)) return;
+        vector<Key> keys = produceKeys();
+        if (pending) pending->cancelled.store(true, memory_order_relaxed);
+        pendingVersion = version;
+        pending = make_shared<BuildJob>();
+        thread(&LazySortedIndex::build, pending, move(keys)).detach();
+    }
+
+    const Entries* tryGet(unsigned long long version) {
+        if (pending && pending->done.load(memory_order_acquire)) {
+            entries = move(pending->result);
+            builtVersion = pendingVersion;
+            pending.reset();
+        }
+        return builtVersion == version ? &entries : nullptr;
+    }
+};
+
+// ------------------- Адаптивный индекс -------------------
+
+// Индекс растрескивания (database cracking) столбца итоговых стоимостей.
+// Копия столбца не сортируется заранее: каждый запрос диапазона
+// разбивает лишь те куски, в которые попали его границы, и запоминает
+// границы. Часто запрашиваемые диапазоны со временем упираются в уже
+// существующие границы и отвечаются без просмотра.
+class CrackingIndex {
+private:
+    vector<double> values;
+    vector<uint32_t> positions;
+    map<double, size_t> bounds;     // значение -> первая позиция, где values >= значения
+    unsigned long long builtVersion = ~0ULL;
+    size_t lastTouched = 0;
+
+    // переставить [from, to) так, чтобы значения < pivot шли первыми
+    size_t partition(size_t from, size_t to, double pivot) {
+        size_t i = from;
+        size_t j = to;
+        while (true) {
+            while (i < j && values[i] < pivot) ++i;
+            while (i < j && !(values[j - 1] < pivot)) --j;
+            if (i >= j) return i;
+            swap(values[i], values[j - 1]);
+            swap(positions[i], positions[j - 1]);
+            ++i;
+            --j;
+        }
+    }
+
+    size_t crack(double pivot) {
+        auto next = bounds.lower_bound(pivot);
+        if (next != bounds.end() && next->first == pivot) return next->second;
+        size_t to = next == bounds.end() ? values.size() : next->second;
+        size_t from = next == bounds.begin() ? 0 : prev(next)->second;
+        lastTouched += to - from;
+        size_t split = partition(from, to, pivot);
+        bounds.emplace_hint(next, pivot, split);
+        return split;
+    }
+
+public:
+    // начать заново, если столбец изменился; копирование без сортировки
+    void ensure(const vector<double>& costs, unsigned long long version) {
+        if (builtVersion == version) return;
+        values = costs;
+        positions.resize(costs.size());
+        for (size_t i = 0; i < positions.size(); ++i) positions[i] = static_cast<uint32_t>(i);
+        bounds.clear();
+        builtVersion = version;
+    }
+
+    // позиции номеров со стоимостью в [low, high] в порядке кусков
+    vector<size_t> findRange(double low, double high) {
+        lastTouched = 0;
+        vector<size_t> result;
+        if (low > high || values.empty()) return result;
+        size_t from = low == -numeric_limits<double>::infinity() ? 0 : crack(low);
+        size_t to = high == numeric_limits<double>::infinity()
+            ? values.size() : crack(nextafter(high, numeric_limits<double>::infinity()));
+        result.assign(positions.begin() + from, positions.begin() + max(from, to));
+        return result;
+    }
+
+    size_t pieceCount() const {
+        return values.empty() ? 0 : bounds.size() + 1;
+    }
+
+    // сколько значений переставил последний запрос
+    size_t getLastTouched() const {
+        return lastTouched;
+    }
+};
+
+// ------------------- Фильтр Блума и импорт -------------------
+
+// Блочный фильтр Блума обозначений номеров: все биты ключа лежат в одном
+// 64-байтном блоке, поэтому проверка стоит не больше одного промаха кэша.
+// ~10 бит на ключ, 4 бита на ключ - около 1% ложных срабатываний.
+class RoomNumberBloomFilter {
+private:
+    static constexpr size_t kWordsPerBlock = 8;
+    static constexpr int kBitsPerKey = 4;
+
+    vector<uint64_t> words;
+    size_t blocks = 0;
+
+    static uint64_t hashOf(string_view number) {
+        return mixHash(hash<string_view>()(number));
+    }
+
+    // младшие 9 * kBitsPerKey бит хеша выбирают биты внутри блока,
+    // блок выбирается по оставшимся старшим, независимым от них битам
+    size_t blockOf(uint64_t h) const {
+        return static_cast<size_t>((h >> (9 * kBitsPerKey)) % blocks) * kWordsPerBlock;
+    }
+
+public:
+    void reset(size_t expectedKeys) {
+        blocks = max<size_t>(1, expectedKeys * 10 / (kWordsPerBlock * 64) + 1);
+        words.assign(blocks * kWordsPerBlock, 0);
+    }
+
+    void add(string_view number) {
+        uint64_t h = hashOf(number);
+        uint64_t* block = &words[blockOf(h)];
+        for (int k = 0; k < kBitsPerKey; ++k) {
+            unsigned bit = static_cast<unsigned>(h >> (9 * k)) & 511;
+            block[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    // false - номера точно нет; true - возможно есть
+    bool mayContain(string_view number) const {
+        uint64_t h = hashOf(number);
+        const uint64_t* block = &words[blockOf(h)];
+        for (int k = 0; k < kBitsPerKey; ++k) {
+            unsigned bit = static_cast<unsigned>(h >> (9 * k)) & 511;
+            if (!(block[bit / 64] & (1ULL << (bit % 64)))) return false;
+        }
+        return true;
+    }
+};
+
+// Итог импорта номеров
+struct ImportReport {
+    size_t added = 0;
+    size_t duplicates = 0;        // обозначение уже было в гостинице или раньше в файле
+    size_t filterNegatives = 0;   // новые номера, отсеянные фильтром без обращения к индексу
+};
+
+// Итог синхронизации с полным файлом номеров
+struct DiffImportReport {
+    size_t added = 0;
+    size_t updated = 0;
+    size_t removed = 0;
+    size_t unchanged = 0;
+};
+
+// Строка файла импорта "<номер> <базовая стоимость> [скидка, %]";
+// false - пустая строка или комментарий '#'. Числа разбираются from_chars:
+// десятичный разделитель всегда точка, какую бы локаль ни установил main.
+// Лишние поля, nan/inf и недопустимые значения - ошибка строки.
+bool parseImportLine(const string& line, int lineNo, string& number, double& baseCost, double& discount) {
+    const char* const blanks = " \t\r\n";
+    size_t pos = 0;
+    auto nextField = [&]() -> string_view {
+        size_t from = line.find_first_not_of(blanks, pos);
+        if (from == string::npos) {
+            pos = line.size();
+            return string_view();
+        }
+        size_t to = line.find_first_of(blanks, from);
+        if (to == string::npos) to = line.size();
+        pos = to;
+        return string_view(line.data() + from, to - from);
+    };
+    auto fail = [&](const string& what) -> InvalidValueException {
+        return InvalidValueException("строка " + to_string(lineNo) + " файла импорта: " + what);
+    };
+    auto toNumber = [&](string_view field, const char* what) {
+        double value = 0.0;
+        auto parsed = from_chars(field.data(), field.data() + field.size(), value);
+        if (parsed.ec != errc() || parsed.ptr != field.data() + field.size() || !isfinite(value)) {
+            throw fail(string("неверная ") + what + " '" + string(field) + "'");
+        }
+        return value;
+    };
+
+    string_view numberField = nextField();
+    if (numberField.empty() || numberField[0] == '#') return false;
+    string_view baseField = nextField();
+    if (baseField.empty()) {
+        throw fail("нет базовой стоимости");
+    }
+    baseCost = toNumber(baseField, "базовая стоимость");
+    if (!isValidBaseCost(baseCost)) {
+        throw fail("базовая стоимость должна быть > 0");
+    }
+    string_view discountField = nextField();
+    discount = discountField.empty() ? 0.0 : toNumber(discountField, "скидка");
+    if (!isValidDiscountPercent(discount)) {
+        throw fail("процент скидки должен быть >= 0 и < 100");
+    }
+    if (!nextField().empty()) {
+        throw fail("лишние поля после скидки");
+    }
+    number.assign(numberField.data(), numberField.size());
+    return true;
+}
+
+// Завершающая строка файла импорта "# end <число номеров>": по ней
+// обнаруживается обрезанный файл. Для остальных парсеров это комментарий.
+bool parseImportTrailer(const string& line, int lineNo, size_t& rows) {
+    istringstream fields(line);
+    string hash;
+    string word;
+    if (!(fields >> hash >> word) || hash != "#" || word != "end") return false;
+    string count;
+    fields >> count;
+    auto parsed = from_chars(count.data(), count.data() + count.size(), rows);
+    string extra;
+    if (count.empty() || parsed.ec != errc() || parsed.ptr != count.data() + count.size() || fields >> extra) {
+        throw InvalidValueException("строка " + to_string(lineNo) + " файла импорта: ожидается '# end <число номеров>'");
+    }
+    return true;
+}
+
+// Общий разбор файла импорта: row(number, baseCost, discount, lineNo) для
+// каждого номера по порядку. Строка "# end" сверяется с числом прочитанных
+// номеров и должна быть последней; requireTrailer - без неё файл считается
+// обрезанным. Возвращает число номеров.
+template <typename Row>
+size_t forEachImportRow(istream& in, bool requireTrailer, Row row) {
+    string line;
+    string number;
+    int lineNo = 0;
+    size_t rows = 0;
+    bool ended = false;
+    auto fail = [&](const string& what) {
+        return InvalidValueException("строка " + to_string(lineNo) + " файла импорта: " + what);
+    };
+    while (getline(in, line)) {
+        ++lineNo;
+        size_t declared = 0;
+        if (parseImportTrailer(line, lineNo, declared)) {
+            if (ended) throw fail("повторная строка '# end'");
+            if (declared != rows) {
+                throw fail("объявлено номеров " + to_string(declared) + ", прочитано " + to_string(rows));
+            }
+            ended = true;
+            continue;
+        }
+        double baseCost = 0.0;
+        double discount = 0.0;
+        if (!parseImportLine(line, lineNo, number, baseCost, discount)) continue;
+        if (ended) throw fail("номер после строки '# end'");
+        ++rows;
+        row(number, baseCost, discount, lineNo);
+    }
+    if (in.bad()) {
+        throw HotelException("ошибка чтения файла импорта");
+    }
+    if (requireTrailer && !ended) {
+        throw HotelException("нет завершающей строки '# end <число номеров>', файл, похоже, обрезан");
+    }
+    return rows;
+}
+
+// Стоимости совпадают до копеек
+bool sameCents(double a, double b) {
+    return llround(a * 100.0) == llround(b * 100.0);
+}
+
+// ------------------- Индекс обозначений номеров -------------------
+
+// Прямая адресация для чисто числовых обозначений ("101".."999"): позиция
+// номера лежит в таблице по индексу, равному числу. Key задаёт допустимый
+// диапазон ключей; таблица растёт до наибольшего встреченного ключа.
+template <typename Key>
+class DirectAddressRoomIndex {
+private:
+    static const uint32_t kMaxDirectKey = 1u << 22;   // не больше 16 МБ на таблицу
+    vector<int32_t> slots;
+
+    static bool parse(const string& number, uint32_t& key) {
+        if (number.empty() || number.size() > 10 || (number[0] == '0' && number.size() > 1)) {
+            return false;   // "0101" и "101" - разные номера, поэтому ведущие нули не допускаются
+        }
+        uint64_t value = 0;
+        for (char c : number) {
+            if (c < '0' || c > '9') return false;
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        if (value > numeric_limits<Key>::max() || value >= kMaxDirectKey) return false;
+        key = static_cast<uint32_t>(value);
+        return true;
+    }
+
+public:
+    bool accepts(const string& number) const {
+        uint32_t key;
+        return parse(number, key);
+    }
+
+    int find(const string& number) const {
+        uint32_t key;
+        if (!parse(number, key) || key >= slots.size()) return -1;
+        return slots[key];
+    }
+
+    void insert(const string& number, uint32_t position) {
+        uint32_t key = 0;
+        parse(number, key);
+        if (key >= slots.size()) {
+            slots.resize(max<size_t>(key + 1, slots.size() * 2), -1);
+        }
+        slots[key] = static_cast<int32_t>(position);
+    }
+
+    void clear() {
+        slots.clear();
+    }
+};
+
+// Хеш-таблица с открытой адресацией для произвольных обозначений. Ключи -
+// ссылки на строки номеров внутри комнат (Key = string_view), поэтому
+// вставка не копирует строку и, кроме редкого роста таблицы, не выделяет память.
+// Строка номера должна жить не меньше записи индекса.
+template <typename Key>
+class HashedRoomIndex {
+private:
+    struct Slot {
+        Key key;
+        int32_t position = -1;   // -1 - пустая ячейка
+    };
+
+    vector<Slot> slots;
+    size_t used = 0;
+
+    size_t findSlot(const Key& key) const {
+        size_t mask = slots.size() - 1;
+        size_t i = hash<Key>()(key) & mask;
+        while (slots[i].position >= 0 && slots[i].key != key) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    // первая пустая ячейка для ключа, которого в таблице точно нет
+    size_t findEmptySlot(const Key& key) const {
+        size_t mask = slots.size() - 1;
+        size_t i = hash<Key>()(key) & mask;
+        while (slots[i].position >= 0) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow() {
+        vector<Slot> old;
+        old.swap(slots);
+        slots.resize(old.empty() ? 16 : old.size() * 2);
+        used = 0;
+        for (const Slot& slot : old) {
+            if (slot.position >= 0) {
+                slots[findEmptySlot(slot.key)] = slot;   // ключи уникальны, строки номеров не читаются
+                ++used;
+            }
+        }
+    }
+
+public:
+    bool accepts(const string&) const {
+        return true;
+    }
+
+    int find(const string& number) const {
+        if (slots.empty()) return -1;
+        return slots[findSlot(Key(number))].position;
+    }
+
+    // true - ключ новый
+    bool insert(const string& number, uint32_t position) {
+        if ((used + 1) * 2 > slots.size()) {
+            grow();
+        }
+        Slot& slot = slots[findSlot(Key(number))];
+        bool added = slot.position < 0;
+        if (added) ++used;
+        slot.key = Key(number);   // для существующего ключа - перенос ссылки на новую строку
+        slot.position = static_cast<int32_t>(position);
+        return added;
+    }
+
+    // вставка ключа, которого точно нет: ищется первая пустая ячейка без
+    // сравнения ключей, т.е. без чтения строк номеров по цепочке проб
+    void insertAbsent(const string& number, uint32_t position) {
+        if ((used + 1) * 2 > slots.size()) {
+            grow();
+        }
+        Slot& slot = slots[findEmptySlot(Key(number))];
+        slot.key = Key(number);
+        slot.position = static_cast<int32_t>(position);
+        ++used;
+    }
+
+    void clear() {
+        slots.clear();
+        used = 0;
+    }
+
+    template <typename Body>
+    void forEachKey(Body body) const {
+        for (const Slot& slot : slots) {
+            if (slot.position >= 0) body(slot.key);
+        }
+    }
+};
+
+// Индекс "обозначение -> позиция номера". Схема ключей выбирается по
+// содержимому при импорте (loadSnapshot) и при первом добавлении: числовые
+// обозначения попадают в таблицу прямой адресации, остальные - в хеш-таблицу.
+// Если новое обозначение не подходит под схему, индекс перестраивается.
+class RoomNumberIndex {
+public:
+    enum class Scheme { Numeric16, Numeric32, String };
+
+private:
+    Scheme scheme = Scheme::Numeric16;
+    DirectAddressRoomIndex<uint16_t> numeric16;
+    DirectAddressRoomIndex<uint32_t> numeric32;
+    HashedRoomIndex<string_view> strings;   // ключи ссылаются на строки номеров в комнатах
+
+    // фильтр Блума перед хеш-таблицей (только для схемы String): отсеивает
+    // новые обозначения при импорте без проб по таблице
+    RoomNumberBloomFilter filter;
+    size_t filterKeys = 0;
+    size_t filterCapacity = 0;
+
+    void addToFilter(const string& number) {
+        if (++filterKeys > filterCapacity) {
+            filterCapacity = max<size_t>(filterKeys * 2, 1024);
+            filter.reset(filterCapacity);
+            strings.forEachKey([&](string_view key) { filter.add(key); });
+        }
+        filter.add(number);
+    }
+
+    template <typename Body>
+    auto dispatch(Body body) const -> decltype(body(strings)) {
+        switch (scheme) {
+        case Scheme::Numeric16: return body(numeric16);
+        case Scheme::Numeric32: return body(numeric32);
+        default: return body(strings);
+        }
+    }
+
+    template <typename Body>
+    void dispatchMutable(Body body) {
+        switch (scheme) {
+        case Scheme::Numeric16: body(numeric16); break;
+        case Scheme::Numeric32: body(numeric32); break;
+        default: body(strings); break;
+        }
+    }
+
+public:
+    template <typename Rooms>
+    static Scheme chooseScheme(const Rooms& rooms) {
+        DirectAddressRoomIndex<uint16_t> probe16;
+        DirectAddressRoomIndex<uint32_t> probe32;
+        bool fits16 = true;
+        bool fits32 = true;
+        for (const auto& r : rooms) {
+            fits16 = fits16 && probe16.accepts(r->getNumber());
+            fits32 = fits32 && probe32.accepts(r->getNumber());
+            if (!fits32) break;
+        }
+        if (fits16) return Scheme::Numeric16;
+        if (fits32) return Scheme::Numeric32;
+        return Scheme::String;
+    }
+
+    Scheme getScheme() const {
+        return scheme;
+    }
+
+    template <typename Rooms>
+    void rebuild(const Rooms& rooms) {
+        numeric16.clear();
+        numeric32.clear();
+        strings.clear();
+        scheme = chooseScheme(rooms);
+        dispatchMutable([&](auto& index) {
+            for (size_t i = 0; i < rooms.size(); ++i) {
+                index.insert(rooms[i]->getNumber(), static_cast<uint32_t>(i));
+            }
+        });
+        filterKeys = 0;
+        filterCapacity = 0;
+        if (scheme == Scheme::String) {
+            filterKeys = rooms.size();
+            filterCapacity = max<size_t>(rooms.size() * 2, 1024);
+            filter.reset(filterCapacity);
+            for (const auto& r : rooms) filter.add(r->getNumber());
+        }
+    }
+
+    // false - обозначения точно нет; для числовых схем всегда true
+    bool mayContain(const string& number) const {
+        return scheme != Scheme::String || filter.mayContain(number);
+    }
+
+    bool accepts(const string& number) const {
+        return dispatch([&](const auto& index) { return index.accepts(number); });
+    }
+
+    int find(const string& number) const {
+        return dispatch([&](const auto& index) { return index.find(number); });
+    }
+
+    void insert(const string& number, uint32_t position) {
+        if (scheme == Scheme::String) {
+            // повторная вставка (updateRoom) лишь переносит ссылку на строку
+            // и не должна второй раз учитываться в заполнении фильтра
+            if (strings.insert(number, position)) addToFilter(number);
+            return;
+        }
+        dispatchMutable([&](auto& index) { index.insert(number, position); });
+    }
+
+    // обозначения number в индексе точно нет (проверено индексом или фильтром)
+    void insertAbsent(const string& number, uint32_t position) {
+        if (scheme == Scheme::String) {
+            strings.insertAbsent(number, position);
+            addToFilter(number);
+        }
+        else {
+            insert(number, position);
+        }
+    }
+};
+
+// ------------------- Групповая агрегация -------------------
+
+// Состояние агрегатов одного столбца значений в группе
+struct AggregateState {
+    size_t count = 0;
+    double sum = 0.0;
+    double min = numeric_limits<double>::infinity();
+    double max = -numeric_limits<double>::infinity();
+
+    void add(double value) {
+        ++count;
+        sum += value;
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+
+    void merge(const AggregateState& other) {
+        count += other.count;
+        sum += other.sum;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+    }
+
+    double average() const {
+        return count ? sum / static_cast<double>(count) : 0.0;
+    }
+};
+
+// Хеш-таблица агрегатов с открытой адресацией: ключ группы -> Columns
+// состояний. Частичные таблицы потоков сливаются через merge.
+template <typename Key, int Columns>
+class HashAggregateTable {
+public:
+    struct Group {
+        Key key{};
+        bool used = false;
+        AggregateState columns[Columns];
+    };
+
+private:
+    vector<Group> slots;
+    size_t groupCount = 0;
+
+    size_t findSlot(const Key& key) const {
+        size_t mask = slots.size() - 1;
+        size_t i = hash<Key>()(key) & mask;
+        while (slots[i].used && !(slots[i].key == key)) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow() {
+        vector<Group> old;
+        old.swap(slots);
+        slots.resize(old.empty() ? 16 : old.size() * 2);
+        for (Group& g : old) {
+            if (g.used) slots[findSlot(g.key)] = move(g);
+        }
+    }
+
+    template <typename K>
+    Group& groupFor(K&& key) {
+        if ((groupCount + 1) * 2 > slots.size()) {
+            grow();
+        }
+        Group& g = slots[findSlot(key)];
+        if (!g.used) {
+            g.used = true;
+            g.key = forward<K>(key);
+            ++groupCount;
+        }
+        return g;
+    }
+
+public:
+    void add(const Key& key, const double (&values)[Columns]) {
+        Group& g = groupFor(key);
+        for (int c = 0; c < Columns; ++c) g.columns[c].add(values[c]);
+    }
+
+    // в пустую таблицу другая просто переносится
+    void merge(HashAggregateTable&& other) {
+        if (groupCount == 0) {
+            slots.swap(other.slots);
+            swap(groupCount, other.groupCount);
+            return;
+        }
+        for (Group& og : other.slots) {
+            if (!og.used) continue;
+            Group& g = groupFor(move(og.key));
+            for (int c = 0; c < Columns; ++c) g.columns[c].merge(og.columns[c]);
+        }
+    }
+
+    size_t size() const {
+        return groupCount;
+    }
+
+    template <typename Body>
+    void forEach(Body body) const {
+        for (const Group& g : slots) {
+            if (g.used) body(g);
+        }
+    }
+};
+
+// Измерения и столбцы для группировки номеров
+enum class GroupDimension { Floor, DiscountTier, Strategy, RoomType };
+enum class ValueColumn { BaseCost, FinalCost, TotalCost };
+
+struct GroupStats {
+    string label;
+    AggregateState stats;
+};
+
+// Этаж по обозначению номера: число из ведущих цифр без двух последних
+// ("305" -> 3, "1204-A" -> 12); -1, если ведущих цифр меньше трёх.
+// Длинные числовые обозначения, этаж которых не помещается в int,
+// относятся к этажу numeric_limits<int>::max().
+int floorOfRoomNumber(const string& number) {
+    size_t digits = 0;
+    long long value = 0;
+    while (digits < number.size() && digits < 12 && isdigit(static_cast<unsigned char>(number[digits]))) {
+        value = value * 10 + (number[digits] - '0');
+        ++digits;
+    }
+    if (digits < 3) return -1;
+    return static_cast<int>(min<long long>(value / 100, numeric_limits<int>::max()));
+}
+
+void printGroupStats(const vector<GroupStats>& groups) {
+    if (groups.empty()) {
+        cout << "Список номеров пуст.\n";
+        return;
+    }
+    cout << fixed << setprecision(2);
+    for (const GroupStats& g : groups) {
+        cout << g.label << ": количество " << g.stats.count
+            << ", сумма " << g.stats.sum
+            << ", среднее " << g.stats.average()
+            << ", мин " << g.stats.min
+            << ", макс " << g.stats.max << '\n';
+    }
+}
+
+// ------------------- Дерево агрегатов -------------------
+
+// Порядок номеров для диапазонных запросов: по этажу, затем по обозначению.
+// Номера одного этажа идут подряд, поэтому диапазон этажей или номеров -
+// непрерывный отрезок этого порядка.
+bool roomOrderLess(const string& a, const string& b) {
+    int floorA = floorOfRoomNumber(a);
+    int floorB = floorOfRoomNumber(b);
+    if (floorA != floorB) return floorA < floorB;
+    return a < b;
+}
+
+// Дерево отрезков над столбцом значений: количество, сумма, минимум и
+// максимум любого отрезка и изменение одного значения за O(log n)
+class SegmentAggregateTree {
+private:
+    size_t leaves = 0;
+    vector<AggregateState> nodes;   // nodes[1] - корень, листья с nodes[leaves]
+
+public:
+    void build(const vector<double>& values) {
+        leaves = 1;
+        while (leaves < values.size()) leaves <<= 1;
+        nodes.assign(2 * leaves, AggregateState());
+        for (size_t i = 0; i < values.size(); ++i) nodes[leaves + i].add(values[i]);
+        for (size_t i = leaves - 1; i >= 1; --i) {
+            nodes[i] = nodes[2 * i];
+            nodes[i].merge(nodes[2 * i + 1]);
+        }
+    }
+
+    void update(size_t position, double value) {
+        size_t i = leaves + position;
+        nodes[i] = AggregateState();
+        nodes[i].add(value);
+        for (i /= 2; i >= 1; i /= 2) {
+            nodes[i] = nodes[2 * i];
+            nodes[i].merge(nodes[2 * i + 1]);
+        }
+    }
+
+    // агрегат значений на позициях [from, to)
+    AggregateState query(size_t from, size_t to) const {
+        AggregateState result;
+        for (size_t l = from + leaves, r = to + leaves; l < r; l /= 2, r /= 2) {
+            if (l & 1) result.merge(nodes[l++]);
+            if (r & 1) result.merge(nodes[--r]);
+        }
+        return result;
+    }
+};
+
+// ------------------- Вероятностные структуры -------------------
+
+// Стоимость и процент скидки как ключ скетча - с точностью до сотых
+long long centsKey(double value) {
+    return llround(value * 100.0);
+}
+
+// Оценка числа различных ключей (HyperLogLog, 2^12 регистров, ошибка ~1.6%).
+// Объединение - поэлементный максимум регистров.
+class HyperLogLog {
+public:
+    static constexpr int kPrecision = 12;
+    static constexpr size_t kRegisters = size_t(1) << kPrecision;
+
+private:
+    vector<uint8_t> registers;
+
+public:
+    HyperLogLog()
+        : registers(kRegisters, 0) {
+    }
+
+    void add(uint64_t key) {
+        uint64_t hash = mixHash(key);
+        size_t index = static_cast<size_t>(hash >> (64 - kPrecision));
+        uint64_t rest = hash << kPrecision;
+        uint8_t rank = 1;
+        while (rank <= 64 - kPrecision && !(rest & (1ULL << 63))) {
+            rest <<= 1;
+            ++rank;
+        }
+        if (rank > registers[index]) registers[index] = rank;
+    }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < kRegisters; ++i) {
+            registers[i] = max(registers[i], other.registers[i]);
+        }
+    }
+
+    double estimate() const {
+        const double m = static_cast<double>(kRegisters);
+        double sum = 0.0;
+        size_t zeros = 0;
+        for (uint8_t r : registers) {
+            sum += ldexp(1.0, -r);
+            if (r == 0) ++zeros;
+        }
+        double e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0) {
+            e = m * log(m / static_cast<double>(zeros));   // малые мощности: линейный подсчёт
+        }
+        return e;
+    }
+};
+
+// Частоты ключей (Count-Min, 5 x 4096 счётчиков; оценка не меньше точной)
+// и кандидаты в самые частые ключи. Объединение - сумма счётчиков, после
+// которой кандидаты обеих сторон переоцениваются.
+class CountMinSketch {
+public:
+    static constexpr size_t kDepth = 5;
+    static constexpr size_t kWidth = 4096;
+    static constexpr size_t kCandidates = 32;
+
+private:
+    vector<uint32_t> counters;
+    vector<pair<long long, uint32_t>> candidates;   // ключ, оценка частоты
+
+    size_t cell(size_t row, long long key) const {
+        uint64_t hash = mixHash(static_cast<uint64_t>(key) ^ (0x51ED270B27A4A5C3ULL * (row + 1)));
+        return row * kWidth + static_cast<size_t>(hash % kWidth);
+    }
+
+    void offer(long long key, uint32_t frequency) {
+        for (auto& c : candidates) {
+            if (c.first == key) {
+                c.second = frequency;
+                return;
+            }
+        }
+        if (candidates.size() < kCandidates) {
+            candidates.emplace_back(key, frequency);
+            return;
+        }
+        auto rarest = min_element(candidates.begin(), candidates.end(),
+            [](const pair<long long, uint32_t>& a, const pair<long long, uint32_t>& b) { return a.second < b.second; });
+        if (frequency > rarest->second) *rarest = make_pair(key, frequency);
+    }
+
+public:
+    CountMinSketch()
+        : counters(kDepth * kWidth, 0) {
+    }
+
+    void add(long long key) {
+        for (size_t row = 0; row < kDepth; ++row) ++counters[cell(row, key)];
+        offer(key, estimate(key));
+    }
+
+    uint32_t estimate(long long key) const {
+        uint32_t result = numeric_limits<uint32_t>::max();
+        for (size_t row = 0; row < kDepth; ++row) result = min(result, counters[cell(row, key)]);
+        return result;
+    }
+
+    void merge(const CountMinSketch& other) {
+        for (size_t i = 0; i < counters.size(); ++i) counters[i] += other.counters[i];
+        vector<pair<long long, uint32_t>> keys = move(candidates);
+        keys.insert(keys.end(), other.candidates.begin(), other.candidates.end());
+        candidates.clear();
+        for (const auto& k : keys) offer(k.first, estimate(k.first));
+    }
+
+    // не больше limit самых частых ключей по убыванию оценки
+    vector<pair<long long, uint32_t>> heavyHitters(size_t limit) const {
+        vector<pair<long long, uint32_t>> result = candidates;
+        sort(result.begin(), result.end(),
+            [](const pair<long long, uint32_t>& a, const pair<long long, uint32_t>& b) { return a.second > b.second; });
+        if (result.size() > limit) result.resize(limit);
+        return result;
+    }
+};
+
+// Скетчи одной гостиницы или объединение скетчей нескольких
+struct HotelSketches {
+    HyperLogLog pricePoints;       // различные итоговые стоимости
+    HyperLogLog discountLevels;    // различные проценты скидки
+    CountMinSketch priceFrequency; // частоты итоговых стоимостей
+    size_t rooms = 0;
+
+    void add(double baseCost, double finalCost) {
+        long long price = centsKey(finalCost);
+        pricePoints.add(static_cast<uint64_t>(price));
+        discountLevels.add(static_cast<uint64_t>(centsKey(discountPercentOf(baseCost, finalCost))));
+        priceFrequency.add(price);
+        ++rooms;
+    }
+
+    void merge(const HotelSketches& other) {
+        pricePoints.merge(other.pricePoints);
+        discountLevels.merge(other.discountLevels);
+        priceFrequency.merge(other.priceFrequency);
+        rooms += other.rooms;
+    }
+};
+
+void printHotelSketches(const HotelSketches& sketches) {
+    cout << fixed << setprecision(0);
+    cout << "Номеров: " << sketches.rooms << '\n';
+    cout << "Различных цен (оценка): " << sketches.pricePoints.estimate() << '\n';
+    cout << "Различных уровней скидки (оценка): " << sketches.discountLevels.estimate() << '\n';
+    cout << "Самые частые цены:\n";
+    cout << setprecision(2);
+    for (const auto& h : sketches.priceFrequency.heavyHitters(5)) {
+        cout << "  " << static_cast<double>(h.first) / 100.0 << ": номеров ~" << h.second << '\n';
+    }
+}
+
+// ------------------- Анализ скидок -------------------
+
+// Выручка до и после скидок в разрезе группы (уровня скидки или стратегии)
+struct DiscountRevenue {
+    string label;
+    size_t rooms = 0;
+    double baseTotal = 0.0;
+    double finalTotal = 0.0;
+
+    double forgone() const {
+        return baseTotal - finalTotal;
+    }
+};
+
+struct DiscountAnalytics {
+    DiscountRevenue total;
+    vector<DiscountRevenue> byTier;       // по корзинам HotelReport::bucketOf
+    vector<DiscountRevenue> byStrategy;   // по убыванию недополученной выручки
+};
+
+void printDiscountAnalytics(const DiscountAnalytics& a) {
+    auto printRow = [](const DiscountRevenue& r) {
+        cout << "  " << r.label << ": номеров " << r.rooms
+            << ", до скидок " << r.baseTotal << ", после " << r.finalTotal
+            << ", недополучено " << r.forgone() << '\n';
+    };
+    cout << fixed << setprecision(2);
+    cout << "Итого:\n";
+    printRow(a.total);
+    cout << "По уровням скидки:\n";
+    for (const DiscountRevenue& r : a.byTier) printRow(r);
+    cout << "По стратегиям:\n";
+    for (const DiscountRevenue& r : a.byStrategy) printRow(r);
+}
+
+// ------------------- Отчёт по гостинице -------------------
+
+struct RoomCostEntry {
+    string number;
+    double finalCost;
+};
+
+// Ежедневный отчёт: все показатели собираются одним проходом по столбцам
+struct HotelReport {
+    static const int kDiscountBuckets = 6;
+
+    size_t roomCount = 0;
+    size_t discountedCount = 0;
+    double averageBaseCost = 0.0;
+    double averageFinalCost = 0.0;
+    double medianBaseCost = 0.0;
+    double medianFinalCost = 0.0;
+    size_t discountBuckets[kDiscountBuckets] = {};
+    vector<RoomCostEntry> mostExpensive;   // по убыванию итоговой стоимости
+    vector<RoomCostEntry> cheapest;        // по возрастанию итоговой стоимости
+
+    static const char* bucketName(int bucket) {
+        static const char* const names[kDiscountBuckets] = {
+            "0%", "до 5%", "5-10%", "10-20%", "20-50%", "больше 50%"
+        };
+        return names[bucket];
+    }
+
+    static int bucketOf(double discountPercent) {
+        if (discountPercent <= 0.0) return 0;
+        if (discountPercent <= 5.0) return 1;
+        if (discountPercent <= 10.0) return 2;
+        if (discountPercent <= 20.0) return 3;
+        if (discountPercent <= 50.0) return 4;
+        return 5;
+    }
+};
+
+double medianOf(vector<double>& values) {
+    if (values.empty()) return 0.0;
+    size_t mid = values.size() / 2;
+    nth_element(values.begin(), values.begin() + mid, values.end());
+    double upper = values[mid];
+    if (values.size() % 2 == 1) return upper;
+    double lower = *max_element(values.begin(), values.begin() + mid);
+    return (lower + upper) / 2.0;
+}
+
+string currentDateText() {
+    time_t now = time(nullptr);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d", localtime(&now));
+    return buffer;
+}
+
+void renderReportText(const HotelReport& r, ostream& out) {
+    out << "===== ОТЧЁТ ПО ГОСТИНИЦЕ " << currentDateText() << " =====\n";
+    out << fixed << setprecision(2);
+    out << "Номеров: " << r.roomCount << " (со скидкой: " << r.discountedCount << ")\n";
+    out << "Средняя стоимость: " << r.averageBaseCost << " до скидок, " << r.averageFinalCost << " после\n";
+    out << "Медианная стоимость: " << r.medianBaseCost << " до скидок, " << r.medianFinalCost << " после\n";
+    out << "Распределение скидок:\n";
+    for (int b = 0; b < HotelReport::kDiscountBuckets; ++b) {
+        out << "  " << HotelReport::bucketName(b) << ": " << r.discountBuckets[b] << '\n';
+    }
+    out << "Самые дорогие номера:\n";
+    for (const RoomCostEntry& e : r.mostExpensive) {
+        out << "  " << left << setw(12) << e.number << e.finalCost << '\n';
+    }
+    out << "Самые дешёвые номера:\n";
+    for (const RoomCostEntry& e : r.cheapest) {
+        out << "  " << left << setw(12) << e.number << e.finalCost << '\n';
+    }
+}
+
+string escapeHtml(const string& text) {
+    string result;
+    for (char c : text) {
+        switch (c) {
+        case '&': result += "&amp;"; break;
+        case '<': result += "&lt;"; break;
+        case '>': result += "&gt;"; break;
+        case '"': result += "&quot;"; break;
+        default: result += c; break;
+        }
+    }
+    return result;
+}
+
+void renderReportHtml(const HotelReport& r, ostream& out) {
+    out << fixed << setprecision(2);
+    out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Отчёт по гостинице</title></head><body>\n";
+    out << "<h1>Отчёт по гостинице " << currentDateText() << "</h1>\n";
+    out << "<table border=\"1\">\n";
+    out << "<tr><th></th><th>До скидок</th><th>После скидок</th></tr>\n";
+    out << "<tr><td>Средняя стоимость</td><td>" << r.averageBaseCost << "</td><td>" << r.averageFinalCost << "</td></tr>\n";
+    out << "<tr><td>Медианная стоимость</td><td>" << r.medianBaseCost << "</td><td>" << r.medianFinalCost << "</td></tr>\n";
+    out << "</table>\n";
+    out << "<p>Номеров: " << r.roomCount << ", со скидкой: " << r.discountedCount << "</p>\n";
+    out << "<h2>Распределение скидок</h2>\n<table border=\"1\">\n";
+    for (int b = 0; b < HotelReport::kDiscountBuckets; ++b) {
+        out << "<tr><td>" << escapeHtml(HotelReport::bucketName(b)) << "</td><td>" << r.discountBuckets[b] << "</td></tr>\n";
+    }
+    out << "</table>\n";
+    const vector<RoomCostEntry>* lists[2] = { &r.mostExpensive, &r.cheapest };
+    const char* titles[2] = { "Самые дорогие номера", "Самые дешёвые номера" };
+    for (int l = 0; l < 2; ++l) {
+        out << "<h2>" << titles[l] << "</h2>\n<table border=\"1\">\n";
+        for (const RoomCostEntry& e : *lists[l]) {
+            out << "<tr><td>" << escapeHtml(e.number) << "</td><td>" << e.finalCost << "</td></tr>\n";
+        }
+        out << "</table>\n";
+    }
+    out << "</body></html>\n";
+}
+
+// Лёгкое невладеющее представление номера гостиницы. Действительно до
+// следующего изменения гостиницы, которая им владеет.
+class RoomView {
+private:
+    const IRoom* room;
+
+public:
+    explicit RoomView(const IRoom& room_)
+        : room(&room_) {
+    }
+
+    const string& getNumber() const {
+        return room->getNumber();
+    }
+
+    double getBaseCost() const {
+        return room->getBaseCost();
+    }
+
+    double getFinalCost() const {
+        return room->getFinalCost();
+    }
+};
+
+// ------------------- Класс гостиницы -------------------
+
+class Hotel {
+private:
+    RoomTypeCatalog roomTypes;                 // объявлен до rooms: номера ссылаются на типы
+    vector<unique_ptr<IRoom>> rooms;           // гостиница единолично владеет номерами
+    unsigned long long version = 0;            // растёт при каждом изменении номеров
+
+    // кэш столбца итоговых стоимостей, действителен пока finalCostsVersion == version
+    mutable vector<double> finalCosts;
+    mutable unsigned long long finalCostsVersion = ~0ULL;
+    mutable vector<double> baseCosts;
+    mutable unsigned long long baseCostsVersion = ~0ULL;
+
+    // налоги и сборы гостиницы и кэш стоимостей с ними
+    FeeSchedule fees;
+    mutable vector<double> totalCosts;
+    mutable unsigned long long totalCostsVersion = ~0ULL;
+
+    // дерево агрегатов итоговых стоимостей в порядке roomOrderLess;
+    // изменение цены номера обновляет его за O(log n), добавление и
+    // удаление номеров - перестройкой при следующем запросе
+    mutable vector<uint32_t> rangeOrder;       // место в порядке -> позиция в rooms
+    mutable vector<uint32_t> rangeRank;        // позиция в rooms -> место в порядке
+    mutable SegmentAggregateTree rangeTree;
+    mutable unsigned long long rangeTreeVersion = ~0ULL;
+
+    // скетчи заводятся при первом запросе и дальше пополняются при каждом
+    // добавлении номера; изменение и удаление номеров требуют пересчёта
+    mutable HotelSketches sketches;
+    mutable unsigned long long sketchesVersion = ~0ULL;
+
+    void ensureRangeTree() const {
+        if (rangeTreeVersion == version) return;
+        rangeOrder.resize(rooms.size());
+        for (size_t i = 0; i < rooms.size(); ++i) rangeOrder[i] = static_cast<uint32_t>(i);
+        sort(rangeOrder.begin(), rangeOrder.end(), [&](uint32_t a, uint32_t b) {
+            return roomOrderLess(rooms[a]->getNumber(), rooms[b]->getNumber());
+        });
+        rangeRank.resize(rooms.size());
+        const vector<double>& costs = getFinalCosts();
+        vector<double> ordered(rooms.size());
+        for (size_t k = 0; k < rangeOrder.size(); ++k) {
+            rangeRank[rangeOrder[k]] = static_cast<uint32_t>(k);
+            ordered[k] = costs[rangeOrder[k]];
+        }
+        rangeTree.build(ordered);
+        rangeTreeVersion = version;
+    }
+
+    // журнал изменений для подписчиков
+    ChangeEventRing changes;
+
+    // вторичные индексы: по итоговой стоимости и по обозначению номера (для префиксов)
+    mutable LazySortedIndex<double> costIndex;
+
+    // адаптивный индекс стоимости для запросов, пока полный индекс не построен
+    mutable CrackingIndex costCracks;
+    mutable LazySortedIndex<string> numberIndex;
+
+    vector<string> getNumbers() const {
+        vector<string> numbers;
+        numbers.reserve(rooms.size());
+        for (const auto& r : rooms) {
+            numbers.push_back(r->getNumber());
+        }
+        return numbers;
+    }
+
+    // обозначение -> позиция в rooms
+    RoomNumberIndex roomKeys;
+
+    bool existsRoomNumber(const string& num) const {
+        return roomKeys.find(num) >= 0;
+    }
+
+    size_t findRoomIndex(const string& num) const {
+        int index = roomKeys.find(num);
+        if (index < 0) {
+            throw RoomNotFoundException("номер '" + num + "' не существует");
+        }
+        return static_cast<size_t>(index);
+    }
+
+    static double sumColumn(const vector<double>& column) {
+        return parallelReduce(0, column.size(), kBulkGrain, 0.0,
+            [&](size_t from, size_t to) {
+                double sum = 0.0;
+                for (size_t i = from; i < to; ++i) sum += column[i];
+                return sum;
+            },
+            [](double a, double b) { return a + b; });
+    }
+
+    void publishChange(RoomChangeKind kind, const IRoom& room) {
+        const RoomType* type = room.getRoomType();
+        const string& typeName = type ? type->name : string();
+        if (kind == RoomChangeKind::Removed) {
+            changes.publish(kind, room.getNumber(), typeName, 0.0, 0.0);
+        }
+        else {
+            changes.publish(kind, room.getNumber(), typeName, room.getBaseCost(), room.getFinalCost());
+        }
+    }
+
+    void insertRoom(unique_ptr<IRoom> room) {
+        const string& number = room->getNumber();
+        if (existsRoomNumber(number)) {
+            throw DuplicateRoomException("номер '" + number + "' уже существует");
+        }
+        appendRoom(move(room));
+    }
+
+    // добавление номера, уникальность которого уже проверена
+    void appendRoom(unique_ptr<IRoom> room) {
+        rooms.push_back(move(room));
+        const IRoom& added = *rooms.back();
+        if (rooms.size() == 1 || !roomKeys.accepts(added.getNumber())) {
+            roomKeys.rebuild(rooms);
+        }
+        else {
+            roomKeys.insertAbsent(added.getNumber(), static_cast<uint32_t>(rooms.size() - 1));
+        }
+        bool sketchesCurrent = sketchesVersion == version;
+        ++version;
+        if (sketchesCurrent) {
+            sketches.add(added.getBaseCost(), added.getFinalCost());
+            sketchesVersion = version;
+        }
+        publishChange(RoomChangeKind::Added, added);
+    }
+
+public:
+    Hotel() = default;
+
+    // Добавить комнату: number (строка), базовая стоимость, скидка в процентах (0 - без скидки).
+    // Строка номера принимается по значению: rvalue перемещается в номер без копирования.
+    void addRoom(string number, double baseCost, double discountPercent = 0.0) {
+        if (number.size() > 50) {
+            cerr << "Предупреждение: обозначение номера слишком длинное\n";
+        }
+
+        addRoom(move(number), baseCost, makeDiscountStrategy(discountPercent));
+    }
+
+    void addRoom(string_view number, double baseCost, double discountPercent = 0.0) {
+        addRoom(string(number), baseCost, discountPercent);
+    }
+
+    void addRoom(const char* number, double baseCost, double discountPercent = 0.0) {
+        addRoom(string(number), baseCost, discountPercent);
+    }
+
+    // Добавить комнату класса по умолчанию (kDefaultRoomClasses); класс
+    // заводится в каталоге типов при первом использовании
+    void addRoomOfClass(const string& number, const string& className) {
+        for (const RoomClassDefaults& c : kDefaultRoomClasses) {
+            if (className == c.name) {
+                if (!roomTypes.find(c.name)) {
+                    defineRoomType(c.name, c.baseCost, kStandardDiscountTiers[c.tierIndex].percent);
+                }
+                addRoomOfType(number, c.name);
+                return;
+            }
+        }
+        throw InvalidValueException("неизвестный класс номера '" + className + "'");
+    }
+
+    // ------- импорт -------
+
+    // Импорт номеров из потока строк "<номер> <базовая стоимость> [скидка, %]"
+    // ('#' - комментарий, необязательная последняя строка "# end <число
+    // номеров>" сверяется). Номера, которые уже есть, пропускаются. Перед
+    // индексом обозначений стоит фильтр Блума: большинство импортируемых
+    // номеров новые, и для них фильтр отвечает "нет" без поиска по индексу,
+    // который при коллизиях читает строки номеров по цепочке проб.
+    // Импорт атомарен: при ошибке в любой строке добавленные номера
+    // удаляются, и гостиница остаётся такой, какой была до импорта.
+    ImportReport importRooms(istream& in, bool useFilter = true) {
+        ImportReport report;
+        size_t roomsBefore = rooms.size();
+        try {
+            forEachImportRow(in, false, [&](string& number, double baseCost, double discount, int) {
+                if (useFilter && !roomKeys.mayContain(number)) {
+                    ++report.filterNegatives;
+                }
+                else if (existsRoomNumber(number)) {
+                    ++report.duplicates;
+                    return;
+                }
+                appendRoom(unique_ptr<IRoom>(new RoomBase(move(number), baseCost, makeDiscountStrategy(discount))));
+                ++report.added;
+            });
+        }
+        catch (...) {
+            // добавленные номера - хвост списка
+            vector<bool> keep(rooms.size(), false);
+            fill(keep.begin(), keep.begin() + roomsBefore, true);
+            removeRoomsWhere(keep);
+            throw;
+        }
+        return report;
+    }
+
+    // Синхронизация с полным файлом номеров в формате importRooms; здесь
+    // последняя строка "# end <число номеров>" обязательна, иначе файл
+    // считается обрезанным. Поток читается дважды: первый проход только
+    // проверяет файл и отмечает битом номера гостиницы, которые в нём есть,
+    // второй применяет изменения. Испорченный файл не меняет ничего, а память -
+    // бит на номер гостиницы и хеш на новый номер, сколько бы строк ни
+    // изменилось. Пустой файл отвергается, удаление больше половины номеров
+    // требует allowMassRemoval. Поток должен допускать перемотку и не
+    // меняться между проходами.
+    DiffImportReport importDiff(istream& in, bool allowMassRemoval = false) {
+        istream::pos_type start = in.tellg();
+        if (start == istream::pos_type(-1)) {
+            throw HotelException("поток импорта не допускает повторного чтения");
+        }
+        auto rewind = [&]() {
+            in.clear();
+            in.seekg(start);
+        };
+        auto fail = [&](int at, const string& what) {
+            return InvalidValueException("строка " + to_string(at) + " файла импорта: " + what);
+        };
+        auto hashOf = [](const string& number) {
+            return mixHash(hash<string>()(number));
+        };
+
+        vector<bool> seen(rooms.size(), false);
+        vector<uint64_t> addedHashes;
+        size_t rows = forEachImportRow(in, true, [&](string& number, double, double, int lineNo) {
+            int position = roomKeys.find(number);
+            if (position < 0) {
+                addedHashes.push_back(hashOf(number));
+                return;
+            }
+            if (seen[position]) {
+                throw fail(lineNo, "номер '" + number + "' уже встречался в файле");
+            }
+            seen[position] = true;
+        });
+        if (rows == 0) {
+            throw HotelException("файл импорта не содержит ни одного номера");
+        }
+
+        // повторы среди новых номеров индекс не видит: совпавшие хеши
+        // проверяются ещё одним чтением, только если они есть
+        sort(addedHashes.begin(), addedHashes.end());
+        vector<uint64_t> suspect;
+        for (size_t i = 1; i < addedHashes.size(); ++i) {
+            if (addedHashes[i] == addedHashes[i - 1] && (suspect.empty() || suspect.back() != addedHashes[i])) {
+                suspect.push_back(addedHashes[i]);
+            }
+        }
+        vector<uint64_t>().swap(addedHashes);
+        if (!suspect.empty()) {
+            rewind();
+            unordered_set<string> suspectNumbers;
+            forEachImportRow(in, true, [&](string& number, double, double, int lineNo) {
+                if (roomKeys.find(number) >= 0 || !binary_search(suspect.begin(), suspect.end(), hashOf(number))) return;
+                if (!suspectNumbers.insert(number).second) {
+                    throw fail(lineNo, "номер '" + number + "' уже встречался в файле");
+                }
+            });
+        }
+
+        size_t missing = static_cast<size_t>(count(seen.begin(), seen.end(), false));
+        if (!allowMassRemoval && missing * 2 > rooms.size()) {
+            throw MassRemovalException(missing, rooms.size());
+        }
+
+        DiffImportReport report;
+        rewind();
+        forEachImportRow(in, true, [&](string& number, double baseCost, double discount, int) {
+            shared_ptr<IDiscountStrategy> strategy = makeDiscountStrategy(discount);
+            int position = roomKeys.find(number);
+            if (position < 0) {
+                appendRoom(unique_ptr<IRoom>(new RoomBase(move(number), baseCost, move(strategy))));
+                seen.push_back(true);
+                ++report.added;
+                return;
+            }
+            const IRoom& current = *rooms[position];
+            if (sameCents(current.getBaseCost(), baseCost) &&
+                sameCents(current.getFinalCost(), strategy->computeCost(baseCost))) {
+                ++report.unchanged;
+            }
+            else {
+                updateRoom(number, baseCost, move(strategy));
+                ++report.updated;
+            }
+        });
+        report.removed = removeRoomsWhere(seen);
+        return report;
+    }
+
+    DiffImportReport importDiff(const string& path, bool allowMassRemoval = false) {
+        ifstream in(path);
+        if (!in) {
+            throw HotelException("не удалось открыть файл импорта '" + path + "'");
+        }
+        return importDiff(in, allowMassRemoval);
+    }
+
+    bool hasRoom(const string& number) const {
+        return existsRoomNumber(number);
+    }
+
+    // false - номера точно нет (ответ фильтра Блума, без проб по индексу)
+    bool mayHaveRoom(const string& number) const {
+        return roomKeys.mayContain(number);
+    }
+
+    ImportReport importRooms(const string& path) {
+        ifstream in(path);
+        if (!in) {
+            throw HotelException("не удалось открыть файл импорта '" + path + "'");
+        }
+        return importRooms(in);
+    }
+
+    // ------- типы номеров -------
+
+    uint32_t defineRoomType(const string& name, double baseCost, double discountPercent = 0.0) {
+        return roomTypes.define(name, baseCost, makeDiscountStrategy(discountPercent));
+    }
+
+    // номер с ценой и скидкой своего типа
+    void addRoomOfType(string number, const string& typeName) {
+        RoomType& type = roomTypes.get(typeName);
+        if (existsRoomNumber(number)) {
+            throw DuplicateRoomException("номер '" + number + "' уже существует");
+        }
+        insertRoom(unique_ptr<IRoom>(new TypedRoom(move(number), type)));
+    }
+
+    // номер типа со своими ценой и скидкой; сохраняются только отличия от типа
+    void addRoomOfType(string number, const string& typeName, double baseCost, double discountPercent) {
+        RoomType& type = roomTypes.get(typeName);
+        if (existsRoomNumber(number)) {
+            throw DuplicateRoomException("номер '" + number + "' уже существует");
+        }
+        insertRoom(unique_ptr<IRoom>(new TypedRoom(move(number), type, baseCost, makeDiscountStrategy(discountPercent))));
+    }
+
+    // Новая цена типа видна всем его номерам сразу; кэши столбцов и индексы
+    // перестраиваются лениво по версии. В журнал уходит одно событие на тип,
+    // а не на каждый номер, поэтому большой тип не переполняет буфер.
+    void repriceRoomType(const string& typeName, double baseCost, double discountPercent) {
+        RoomType& type = roomTypes.get(typeName);
+        roomTypes.reprice(type, baseCost, makeDiscountStrategy(discountPercent));
+        ++version;
+        changes.publish(RoomChangeKind::TypeRepriced, string(), type.name, type.baseCost,
+            type.strategy->computeCost(type.baseCost));
+    }
+
+    const RoomTypeCatalog& getRoomTypes() const {
+        return roomTypes;
+    }
+
+    void printRoomTypes() const {
+        if (roomTypes.size() == 0) {
+            cout << "Типы номеров не заданы.\n";
+            return;
+        }
+        cout << fixed << setprecision(2);
+        for (uint32_t id = 0; id < roomTypes.size(); ++id) {
+            const RoomType& t = roomTypes.get(id);
+            cout << "#" << t.id << " " << t.name << ": " << t.baseCost << " -> "
+                << t.strategy->computeCost(t.baseCost) << ", " << t.strategy->describe()
+                << ", номеров: " << t.roomCount << '\n';
+        }
+    }
+
+    // Добавить комнату с готовой стратегией скидки (например, из таблицы правил)
+    void addRoom(string number, double baseCost, shared_ptr<IDiscountStrategy> strategy) {
+        if (existsRoomNumber(number)) {
+            throw DuplicateRoomException("номер '" + number + "' уже существует");
+        }
+        insertRoom(unique_ptr<IRoom>(new RoomBase(move(number), baseCost, move(strategy))));
+    }
+
+    // Создать комнату типа Room прямо из аргументов её конструктора
+    template <typename Room = RoomBase, typename... Args>
+    RoomView emplaceRoom(Args&&... args) {
+        insertRoom(unique_ptr<IRoom>(new Room(forward<Args>(args)...)));
+        return RoomView(*rooms.back());
+    }
+
+    void reserve(size_t count) {
+        rooms.reserve(count);
+    }
+
+    // ------- доступ к номерам -------
+
+    size_t size() const {
+        return rooms.size();
+    }
+
+    RoomView roomAt(size_t index) const {
+        return RoomView(*rooms.at(index));
+    }
+
+    RoomView findRoom(const string& number) const {
+        return RoomView(*rooms[findRoomIndex(number)]);
+    }
+
+    // Совместимость с кодом, который хранит shared_ptr на номер: возвращается
+    // отдельная неизменяемая копия номера, не зависящая от жизни гостиницы
+    shared_ptr<const IRoom> shareRoom(const string& number) const {
+        const IRoom& room = *rooms[findRoomIndex(number)];
+        return make_shared<RoomBase>(room.getNumber(), room.getBaseCost(),
+            make_shared<FixedCostStrategy>(room.getFinalCost()));
+    }
+
+    // Изменить стоимость и скидку существующей комнаты
+    void updateRoom(const string& number, double baseCost, double discountPercent = 0.0) {
+        updateRoom(number, baseCost, makeDiscountStrategy(discountPercent));
+    }
+
+    // номер типа остаётся номером того же типа: новые цена и скидка
+    // сохраняются как его отличия от типа
+    void updateRoom(const string& number, double baseCost, shared_ptr<IDiscountStrategy> strategy) {
+        size_t index = findRoomIndex(number);
+        const RoomType* type = rooms[index]->getRoomType();
+        unique_ptr<IRoom> room = type
+            ? unique_ptr<IRoom>(new TypedRoom(number, roomTypes.get(type->id), baseCost, move(strategy)))
+            : unique_ptr<IRoom>(new RoomBase(number, baseCost, move(strategy)));
+        unique_ptr<IRoom> previous = move(rooms[index]);   // ключ индекса ссылается на её строку, пока не заменён
+        rooms[index] = move(room);
+        roomKeys.insert(rooms[index]->getNumber(), static_cast<uint32_t>(index));
+        bool treeCurrent = rangeTreeVersion == version;
+        ++version;
+        if (treeCurrent) {
+            rangeTree.update(rangeRank[index], rooms[index]->getFinalCost());
+            rangeTreeVersion = version;
+        }
+        publishChange(RoomChangeKind::Updated, *rooms[index]);
+    }
+
+    void removeRoom(const string& number) {
+        size_t index = findRoomIndex(number);
+        unique_ptr<IRoom> room = move(rooms[index]);
+        rooms.erase(rooms.begin() + index);
+        roomKeys.rebuild(rooms);
+        ++version;
+        publishChange(RoomChangeKind::Removed, *room);
+    }
+
+    // удалить одним проходом номера, для которых keep[i] == false
+    size_t removeRoomsWhere(const vector<bool>& keep) {
+        vector<unique_ptr<IRoom>> removed;
+        size_t kept = 0;
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            if (keep[i]) {
+                rooms[kept++] = move(rooms[i]);
+            }
+            else {
+                removed.push_back(move(rooms[i]));
+            }
+        }
+        if (removed.empty()) return 0;
+        rooms.resize(kept);
+        roomKeys.rebuild(rooms);
+        ++version;
+        for (const auto& room : removed) {
+            publishChange(RoomChangeKind::Removed, *room);
+        }
+        return removed.size();
+    }
+
+    ChangeEventRing& getChangeStream() {
+        return changes;
+    }
+
+    // ------- снимки -------
+
+    vector<SnapshotRow> snapshotRows() const {
+        vector<SnapshotRow> rows;
+        rows.reserve(rooms.size());
+        const vector<double>& costs = getFinalCosts();
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            rows.push_back({ rooms[i]->getNumber(), rooms[i]->getBaseCost(), costs[i] });
+        }
+        return rows;
+    }
+
+    void saveSnapshot(const string& path) const {
+        ofstream out(path);
+        if (!out) {
+            throw HotelException("не удалось открыть файл снимка '" + path + "'");
+        }
+        writeSnapshot(out, changes.getHead(), snapshotRows());
+    }
+
+    // Заменить все номера строками снимка. Итоговая стоимость берётся из
+    // снимка как есть; подписчики журнала получают удаления и добавления.
+    void loadSnapshot(const vector<SnapshotRow>& rows) {
+        vector<unique_ptr<IRoom>> loaded;
+        loaded.reserve(rows.size());
+        for (const SnapshotRow& row : rows) {
+            loaded.push_back(make_unique<RoomBase>(row.number, row.baseCost, make_shared<FixedCostStrategy>(row.finalCost)));
+        }
+        for (const auto& r : rooms) {
+            publishChange(RoomChangeKind::Removed, *r);
+        }
+        rooms.swap(loaded);
+        roomKeys.rebuild(rooms);
+        ++version;
+        for (const auto& r : rooms) {
+            publishChange(RoomChangeKind::Added, *r);
+        }
+        buildIndexesInBackground();
+    }
+
+    void loadSnapshot(const string& path) {
+        ifstream in(path);
+        if (!in) {
+            throw HotelException("не удалось открыть файл снимка '" + path + "'");
+        }
+        unsigned long long sequence = 0;
+        loadSnapshot(readSnapshot(in, sequence));
+    }
+
+    unsigned long long getVersion() const {
+        return version;
+    }
+
+    RoomNumberIndex::Scheme getKeyScheme() const {
+        return roomKeys.getScheme();
+    }
+
+    void setFeeSchedule(const FeeSchedule& schedule) {
+        fees = schedule;
+        ++version;
+    }
+
+    const FeeSchedule& getFeeSchedule() const {
+        return fees;
+    }
+
+    // столбец итоговых стоимостей в порядке добавления номеров
+    const vector<double>& getFinalCosts() const {
+        if (finalCostsVersion != version) {
+            finalCosts.resize(rooms.size());
+            parallelFor(0, rooms.size(), kBulkGrain, [this](size_t from, size_t to) {
+                for (size_t i = from; i < to; ++i) {
+                    finalCosts[i] = rooms[i]->getFinalCost();
+                }
+            });
+            finalCostsVersion = version;
+        }
+        return finalCosts;
+    }
+
+    // столбец стоимостей с налогами и сборами, кэшируется рядом с итоговыми
+    const vector<double>& getTotalCosts() const {
+        if (totalCostsVersion != version) {
+            fees.applyBatch(getFinalCosts(), totalCosts);
+            totalCostsVersion = version;
+        }
+        return totalCosts;
+    }
+
+    // столбец базовых стоимостей в порядке добавления номеров, кэшируется как итоговые
+    const vector<double>& getBaseCosts() const {
+        if (baseCostsVersion != version) {
+            baseCosts.resize(rooms.size());
+            for (size_t i = 0; i < rooms.size(); ++i) {
+                baseCosts[i] = rooms[i]->getBaseCost();
+            }
+            baseCostsVersion = version;
+        }
+        return baseCosts;
+    }
+
+    // цены всех номеров по формуле партнёра, вычисленные одним пакетом
+    vector<double> priceByFormula(const PricingFormula& formula) const {
+        vector<double> prices;
+        formula.evaluateBatch(getBaseCosts(), prices);
+        return prices;
+    }
+
+    void printPrices(const vector<double>& prices, const string& title) const {
+        if (rooms.empty()) {
+            cout << "Список номеров пуст.\n";
+            return;
+        }
+        cout << left << setw(12) << "Номер" << setw(14) << "Баз.стоимость" << setw(16) << title << '\n';
+        for (size_t i = 0; i < rooms.size() && i < prices.size(); ++i) {
+            cout << left << setw(12) << rooms[i]->getNumber()
+                << setw(14) << fixed << setprecision(2) << rooms[i]->getBaseCost()
+                << setw(16) << fixed << setprecision(2) << prices[i]
+                << '\n';
+        }
+    }
+
+    double calculateAverageCost() const {
+        if (rooms.empty()) {
+            throw EmptyRoomListException("нечего усреднять");
+        }
+        return sumColumn(getFinalCosts()) / static_cast<double>(rooms.size());
+    }
+
+    double calculateAverageTotalCost() const {
+        if (rooms.empty()) {
+            throw EmptyRoomListException("нечего усреднять");
+        }
+        return sumColumn(getTotalCosts()) / static_cast<double>(rooms.size());
+    }
+
+    // ------- отчёт -------
+
+    // Все показатели отчёта за один проход: суммы, столбцы для медиан,
+    // распределение скидок и первые/последние topN номеров по стоимости
+    HotelReport buildReport(size_t topN = 5) const {
+        HotelReport report;
+        report.roomCount = rooms.size();
+        if (rooms.empty()) return report;
+
+        const vector<double>& finals = getFinalCosts();
+        vector<double> bases(rooms.size());
+        vector<double> finalsForMedian(rooms.size());
+        auto moreExpensive = [&](size_t a, size_t b) { return finals[a] > finals[b]; };
+        auto cheaper = [&](size_t a, size_t b) { return finals[a] < finals[b]; };
+        vector<size_t> top;      // куча: на вершине самый дешёвый из отобранных дорогих
+        vector<size_t> bottom;   // куча: на вершине самый дорогой из отобранных дешёвых
+        double baseSum = 0.0;
+        double finalSum = 0.0;
+
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            double base = rooms[i]->getBaseCost();
+            double finalCost = finals[i];
+            bases[i] = base;
+            finalsForMedian[i] = finalCost;
+            baseSum += base;
+            finalSum += finalCost;
+
+            double discount = discountPercentOf(base, finalCost);
+            if (discount > 0.0) ++report.discountedCount;
+            ++report.discountBuckets[HotelReport::bucketOf(discount)];
+
+            if (top.size() < topN) {
+                top.push_back(i);
+                push_heap(top.begin(), top.end(), moreExpensive);
+            }
+            else if (topN > 0 && finals[i] > finals[top.front()]) {
+                pop_heap(top.begin(), top.end(), moreExpensive);
+                top.back() = i;
+                push_heap(top.begin(), top.end(), moreExpensive);
+            }
+            if (bottom.size() < topN) {
+                bottom.push_back(i);
+                push_heap(bottom.begin(), bottom.end(), cheaper);
+            }
+            else if (topN > 0 && finals[i] < finals[bottom.front()]) {
+                pop_heap(bottom.begin(), bottom.end(), cheaper);
+                bottom.back() = i;
+                push_heap(bottom.begin(), bottom.end(), cheaper);
+            }
+        }
+
+        double n = static_cast<double>(rooms.size());
+        report.averageBaseCost = baseSum / n;
+        report.averageFinalCost = finalSum / n;
+        report.medianBaseCost = medianOf(bases);
+        report.medianFinalCost = medianOf(finalsForMedian);
+
+        sort_heap(top.begin(), top.end(), moreExpensive);
+        sort_heap(bottom.begin(), bottom.end(), cheaper);
+        for (size_t i : top) report.mostExpensive.push_back({ rooms[i]->getNumber(), finals[i] });
+        for (size_t i : bottom) report.cheapest.push_back({ rooms[i]->getNumber(), finals[i] });
+        return report;
+    }
+
+    // ------- аналитика скидок -------
+
+    // Недополученная из-за скидок выручка: итог, по уровням скидки и по
+    // стратегиям. Каждый поток агрегирует свой отрезок номеров в одну
+    // частичную хеш-таблицу по ключу группы стратегии, таблицы затем сливаются.
+    DiscountAnalytics analyzeDiscounts() const {
+        typedef HashAggregateTable<StrategyGroupKey, 2> StrategyTable;
+        struct Partial {
+            StrategyTable byStrategy;
+            AggregateState tierBase[HotelReport::kDiscountBuckets];
+            AggregateState tierFinal[HotelReport::kDiscountBuckets];
+        };
+
+        const vector<double>& finals = getFinalCosts();
+        Partial merged = parallelAccumulate<Partial>(0, rooms.size(), kBulkGrain,
+            [&](Partial& p, size_t from, size_t to) {
+                for (size_t i = from; i < to; ++i) {
+                    double base = rooms[i]->getBaseCost();
+                    double values[2] = { base, finals[i] };
+                    const IDiscountStrategy* strategy = rooms[i]->getDiscountStrategy();
+                    p.byStrategy.add(strategy ? strategy->groupKey() : StrategyGroupKey(), values);
+                    int tier = HotelReport::bucketOf(discountPercentOf(base, finals[i]));
+                    p.tierBase[tier].add(base);
+                    p.tierFinal[tier].add(finals[i]);
+                }
+            },
+            [](Partial& into, Partial&& part) {
+                into.byStrategy.merge(move(part.byStrategy));
+                for (int t = 0; t < HotelReport::kDiscountBuckets; ++t) {
+                    into.tierBase[t].merge(part.tierBase[t]);
+                    into.tierFinal[t].merge(part.tierFinal[t]);
+                }
+            });
+
+        DiscountAnalytics result;
+        result.total.label = "все номера";
+        for (int t = 0; t < HotelReport::kDiscountBuckets; ++t) {
+            DiscountRevenue r;
+            r.label = HotelReport::bucketName(t);
+            r.rooms = merged.tierBase[t].count;
+            r.baseTotal = merged.tierBase[t].sum;
+            r.finalTotal = merged.tierFinal[t].sum;
+            result.total.rooms += r.rooms;
+            result.total.baseTotal += r.baseTotal;
+            result.total.finalTotal += r.finalTotal;
+            result.byTier.push_back(r);
+        }
+
+        map<string, DiscountRevenue> byLabel;
+        merged.byStrategy.forEach([&](const StrategyTable::Group& g) {
+            string label = g.key.sample ? g.key.sample->describe() : "без стратегии";
+            DiscountRevenue& r = byLabel[label];
+            r.label = label;
+            r.rooms += g.columns[0].count;
+            r.baseTotal += g.columns[0].sum;
+            r.finalTotal += g.columns[1].sum;
+        });
+        for (auto& entry : byLabel) {
+            result.byStrategy.push_back(entry.second);
+        }
+        sort(result.byStrategy.begin(), result.byStrategy.end(),
+            [](const DiscountRevenue& a, const DiscountRevenue& b) { return a.forgone() > b.forgone(); });
+        return result;
+    }
+
+    // ------- групповая статистика -------
+
+    // Хеш-агрегация столбца values по ключу keyOf(позиция): каждый поток
+    // агрегирует свой отрезок в одну таблицу, таблицы сливаются в конце
+    template <typename Key, typename KeyOf>
+    vector<pair<Key, AggregateState>> aggregateGroups(const vector<double>& values, KeyOf keyOf) const {
+        typedef HashAggregateTable<Key, 1> Table;
+        Table merged = parallelAccumulate<Table>(0, values.size(), kBulkGrain,
+            [&](Table& table, size_t from, size_t to) {
+                for (size_t i = from; i < to; ++i) {
+                    double row[1] = { values[i] };
+                    table.add(keyOf(i), row);
+                }
+            },
+            [](Table& into, Table&& part) {
+                into.merge(move(part));
+            });
+
+        vector<pair<Key, AggregateState>> groups;
+        merged.forEach([&](const typename Table::Group& g) {
+            groups.emplace_back(g.key, g.columns[0]);
+        });
+        return groups;
+    }
+
+    const vector<double>& getColumn(ValueColumn column) const {
+        switch (column) {
+        case ValueColumn::BaseCost: return getBaseCosts();
+        case ValueColumn::TotalCost: return getTotalCosts();
+        default: return getFinalCosts();
+        }
+    }
+
+    // count/sum/avg/min/max столбца column в разрезе измерения dimension
+    vector<GroupStats> groupBy(GroupDimension dimension, ValueColumn column) const {
+        const vector<double>& values = getColumn(column);
+        vector<GroupStats> result;
+
+        if (dimension == GroupDimension::Strategy) {
+            auto groups = aggregateGroups<StrategyGroupKey>(values, [&](size_t i) {
+                const IDiscountStrategy* strategy = rooms[i]->getDiscountStrategy();
+                return strategy ? strategy->groupKey() : StrategyGroupKey();
+            });
+            // группы с одинаковым описанием сливаются, как в analyzeDiscounts
+            map<string, AggregateState> byLabel;
+            for (const auto& g : groups) {
+                byLabel[g.first.sample ? g.first.sample->describe() : "без стратегии"].merge(g.second);
+            }
+            for (const auto& entry : byLabel) {
+                result.push_back({ entry.first, entry.second });
+            }
+            sort(result.begin(), result.end(),
+                [](const GroupStats& a, const GroupStats& b) { return a.stats.count > b.stats.count; });
+            return result;
+        }
+
+        if (dimension == GroupDimension::RoomType) {
+            auto groups = aggregateGroups<int>(values, [&](size_t i) {
+                const RoomType* type = rooms[i]->getRoomType();
+                return type ? static_cast<int>(type->id) : -1;
+            });
+            sort(groups.begin(), groups.end(),
+                [](const pair<int, AggregateState>& a, const pair<int, AggregateState>& b) { return a.first < b.first; });
+            for (const auto& g : groups) {
+                result.push_back({ g.first < 0 ? string("без типа") : roomTypes.get(static_cast<uint32_t>(g.first)).name, g.second });
+            }
+            return result;
+        }
+
+        const vector<double>& finals = getFinalCosts();
+        auto groups = dimension == GroupDimension::Floor
+            ? aggregateGroups<int>(values, [&](size_t i) { return floorOfRoomNumber(rooms[i]->getNumber()); })
+            : aggregateGroups<int>(values, [&](size_t i) {
+                return HotelReport::bucketOf(discountPercentOf(rooms[i]->getBaseCost(), finals[i]));
+            });
+        sort(groups.begin(), groups.end(),
+            [](const pair<int, AggregateState>& a, const pair<int, AggregateState>& b) { return a.first < b.first; });
+        for (const auto& g : groups) {
+            string label;
+            if (dimension == GroupDimension::Floor) {
+                label = g.first < 0 ? string("без этажа") : "этаж " + to_string(g.first);
+            }
+            else {
+                label = string("скидка ") + HotelReport::bucketName(g.first);
+            }
+            result.push_back({ label, g.second });
+        }
+        return result;
+    }
+
+    // Статистика итоговых стоимостей номеров с обозначениями от from до to
+    // включительно (в порядке этаж, обозначение) за O(log n)
+    AggregateState rangeStatsByNumber(const string& from, const string& to) const {
+        ensureRangeTree();
+        auto byNumber = [&](uint32_t position, const string& bound) {
+            return roomOrderLess(rooms[position]->getNumber(), bound);
+        };
+        size_t first = lower_bound(rangeOrder.begin(), rangeOrder.end(), from, byNumber) - rangeOrder.begin();
+        size_t last = upper_bound(rangeOrder.begin(), rangeOrder.end(), to, [&](const string& bound, uint32_t position) {
+            return roomOrderLess(bound, rooms[position]->getNumber());
+        }) - rangeOrder.begin();
+        return first < last ? rangeTree.query(first, last) : AggregateState();
+    }
+
+    // то же для этажей fromFloor..toFloor
+    AggregateState rangeStatsByFloor(int fromFloor, int toFloor) const {
+        ensureRangeTree();
+        size_t first = partition_point(rangeOrder.begin(), rangeOrder.end(), [&](uint32_t position) {
+            return floorOfRoomNumber(rooms[position]->getNumber()) < fromFloor;
+        }) - rangeOrder.begin();
+        size_t last = partition_point(rangeOrder.begin(), rangeOrder.end(), [&](uint32_t position) {
+            return floorOfRoomNumber(rooms[position]->getNumber()) <= toFloor;
+        }) - rangeOrder.begin();
+        return first < last ? rangeTree.query(first, last) : AggregateState();
+    }
+
+    // Приближённые число различных цен и скидок и самые частые цены
+    const HotelSketches& getSketches() const {
+        if (sketchesVersion != version) {
+            sketches = HotelSketches();
+            const vector<double>& costs = getFinalCosts();
+            for (size_t i = 0; i < rooms.size(); ++i) sketches.add(rooms[i]->getBaseCost(), costs[i]);
+            sketchesVersion = version;
+        }
+        return sketches;
+    }
+
+    // ------- индексы и поиск -------
+
+    void buildIndexesInBackground() const {
+        costIndex.startBuild(version, [this] { return getFinalCosts(); });
+        numberIndex.startBuild(version, [this] { return getNumbers(); });
+    }
+
+    bool isCostIndexReady() const {
+        return costIndex.tryGet(version) != nullptr;
+    }
+
+    bool isNumberIndexReady() const {
+        return numberIndex.tryGet(version) != nullptr;
+    }
+
+    // позиции номеров с итоговой стоимостью в [low, high], по возрастанию стоимости
+    vector<size_t> findByCostRange(double low, double high) const {
+        vector<size_t> result;
+        if (const auto* index = costIndex.tryGet(version)) {
+            auto from = lower_bound(index->begin(), index->end(), make_pair(low, static_cast<uint32_t>(0)));
+            for (auto it = from; it != index->end() && it->first <= high; ++it) {
+                result.push_back(it->second);
+            }
+            return result;
+        }
+
+        // полный индекс не сортируется ради редких запросов: столбец
+        // растрескивается по границам пришедших диапазонов
+        const vector<double>& costs = getFinalCosts();
+        costCracks.ensure(costs, version);
+        result = costCracks.findRange(low, high);
+        sort(result.begin(), result.end(), [&](size_t a, size_t b) {
+            return costs[a] < costs[b] || (costs[a] == costs[b] && a < b);
+        });
+        return result;
+    }
+
+    // кусков в адаптивном индексе стоимости и значений, переставленных последним запросом
+    size_t getCostCrackPieces() const {
+        return costCracks.pieceCount();
+    }
+
+    size_t getCostCrackTouched() const {
+        return costCracks.getLastTouched();
+    }
+
+    // позиции номеров, обозначение которых начинается с prefix, по алфавиту
+    vector<size_t> findByPrefix(const string& prefix) const {
+        vector<size_t> result;
+        if (const auto* index = numberIndex.tryGet(version)) {
+            auto from = lower_bound(index->begin(), index->end(), make_pair(prefix, static_cast<uint32_t>(0)));
+            for (auto it = from; it != index->end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+                result.push_back(it->second);
+            }
+            return result;
+        }
+
+        numberIndex.startBuild(version, [this] { return getNumbers(); });
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            if (rooms[i]->getNumber().compare(0, prefix.size(), prefix) == 0) result.push_back(i);
+        }
+        sort(result.begin(), result.end(), [&](size_t a, size_t b) { return rooms[a]->getNumber() < rooms[b]->getNumber(); });
+        return result;
+    }
+
+    void printRooms(const vector<size_t>& positions) const {
+        if (positions.empty()) {
+            cout << "Подходящих номеров нет.\n";
+            return;
+        }
+        const vector<double>& costs = getFinalCosts();
+        cout << left << setw(12) << "Номер" << setw(14) << "Баз.стоимость" << setw(16) << "После скидки" << '\n';
+        for (size_t i : positions) {
+            cout << left << setw(12) << rooms[i]->getNumber()
+                << setw(14) << fixed << setprecision(2) << rooms[i]->getBaseCost()
+                << setw(16) << fixed << setprecision(2) << costs[i]
+                << '\n';
+        }
+    }
+
+    void printAll() const {
+        if (rooms.empty()) {
             cout << "Список номеров пуст.\n";
             return;
         }
-        cout << "Текущие номера:\n";
-        cout << left << setw(12) << "Номер" << setw(14) << "Баз.стоимость" << setw(16) << "После скидки" << '\n';
-        for (const auto& r : rooms) {
-            cout << left << setw(12) << r->getNumber()
-                << setw(14) << fixed << setprecision(2) << r->getBaseCost()
-                << setw(16) << fixed << setprecision(2) << r->getFinalCost()
-                << '\n';
-        }
+        cout << "Текущие номера:\n";
+        cout << left << setw(12) << "Номер" << setw(14) << "Баз.стоимость" << setw(16) << "После скидки" << '\n';
+        for (const auto& r : rooms) {
+            cout << left << setw(12) << r->getNumber()
+                << setw(14) << fixed << setprecision(2) << r->getBaseCost()
+                << setw(16) << fixed << setprecision(2) << r->getFinalCost()
+                << '\n';
+        }
+    }
+};
+
+// ------------------- Язык запросов -------------------
+
+// Запросы к таблице номеров:
+//   SELECT <список> FROM rooms [WHERE <условие>] [GROUP BY <столбец>]
+//       [ORDER BY <элемент> [ASC|DESC]] [LIMIT <n>]
+// Столбцы: number, base, final, total (с налогами), discount (процент), floor.
+// Список: * | столбец | COUNT(*) | COUNT/SUM/AVG/MIN/MAX(столбец), через запятую.
+// Условие: сравнения (= != <> < <= > >=) столбца с числом или строкой в
+// кавычках, number LIKE 'A%', AND, OR, NOT и скобки.
+// Условие выполняется над векторами позиций: каждый предикат одним циклом
+// отбирает позиции из входного вектора. Для условий на final и префикса
+// номера планировщик берёт кандидатов из готовых индексов гостиницы.
+
+enum class QueryColumn { Number, Base, Final, Total, Discount, Floor };
+enum class QueryAggregate { None, Count, Sum, Avg, Min, Max };
+enum class CompareOp { Eq, Ne, Lt, Le, Gt, Ge };
+
+class QueryException : public HotelException {
+public:
+    explicit QueryException(const string& msg)
+        : HotelException("Ошибка запроса: " + msg) {
+    }
+};
+
+struct QuerySelectItem {
+    QueryAggregate aggregate = QueryAggregate::None;
+    QueryColumn column = QueryColumn::Number;
+    bool countStar = false;
+    string text;   // как элемент записан в запросе, для заголовка и ORDER BY
+};
+
+struct QueryPredicate {
+    enum class Kind { Compare, Like, And, Or, Not };
+    Kind kind = Kind::Compare;
+    QueryColumn column = QueryColumn::Number;
+    CompareOp op = CompareOp::Eq;
+    double number = 0.0;
+    string text;
+    bool textLiteral = false;
+    unique_ptr<QueryPredicate> left;
+    unique_ptr<QueryPredicate> right;
+};
+
+struct ParsedQuery {
+    vector<QuerySelectItem> select;
+    unique_ptr<QueryPredicate> where;
+    bool hasGroupBy = false;
+    QueryColumn groupBy = QueryColumn::Number;
+    bool hasOrderBy = false;
+    string orderBy;
+    bool orderDescending = false;
+    size_t limit = numeric_limits<size_t>::max();
+};
+
+const char* queryColumnName(QueryColumn column) {
+    switch (column) {
+    case QueryColumn::Number: return "number";
+    case QueryColumn::Base: return "base";
+    case QueryColumn::Final: return "final";
+    case QueryColumn::Total: return "total";
+    case QueryColumn::Discount: return "discount";
+    case QueryColumn::Floor: return "floor";
+    }
+    return "?";
+}
+
+bool parseQueryColumn(const string& name, QueryColumn& column) {
+    static const QueryColumn all[] = { QueryColumn::Number, QueryColumn::Base, QueryColumn::Final,
+                                       QueryColumn::Total, QueryColumn::Discount, QueryColumn::Floor };
+    for (QueryColumn c : all) {
+        if (name == queryColumnName(c)) {
+            column = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+class QueryParser {
+private:
+    struct Token {
+        enum class Type { Word, Number, String, Symbol, End };
+        Type type;
+        string text;     // слова приводятся к нижнему регистру
+        double number;
+    };
+
+    vector<Token> tokens;
+    size_t pos = 0;
+
+    void tokenize(const string& source) {
+        size_t i = 0;
+        while (i < source.size()) {
+            unsigned char c = static_cast<unsigned char>(source[i]);
+            if (isspace(c)) {
+                ++i;
+            }
+            else if (isalpha(c) || c == '_') {
+                size_t start = i;
+                while (i < source.size() && (isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_')) ++i;
+                string word = source.substr(start, i - start);
+                for (char& ch : word) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+                tokens.push_back({ Token::Type::Word, word, 0.0 });
+            }
+            else if (isdigit(c) || (c == '.' && i + 1 < source.size() && isdigit(static_cast<unsigned char>(source[i + 1])))) {
+                double value = 0.0;
+                size_t used = parseLeadingNumber(source.data() + i, source.data() + source.size(), value);
+                if (used == 0) throw QueryException("неверное число в позиции " + to_string(i + 1));
+                tokens.push_back({ Token::Type::Number, source.substr(i, used), value });
+                i += used;
+            }
+            else if (c == '\'') {
+                size_t end = source.find('\'', i + 1);
+                if (end == string::npos) throw QueryException("незакрытая строка");
+                tokens.push_back({ Token::Type::String, source.substr(i + 1, end - i - 1), 0.0 });
+                i = end + 1;
+            }
+            else {
+                string two = source.substr(i, 2);
+                if (two == "<=" || two == ">=" || two == "!=" || two == "<>") {
+                    tokens.push_back({ Token::Type::Symbol, two, 0.0 });
+                    i += 2;
+                }
+                else if (string("(),*=<>").find(static_cast<char>(c)) != string::npos) {
+                    tokens.push_back({ Token::Type::Symbol, string(1, static_cast<char>(c)), 0.0 });
+                    ++i;
+                }
+                else {
+                    throw QueryException(string("неожиданный символ '") + static_cast<char>(c) + "'");
+                }
+            }
+        }
+        tokens.push_back({ Token::Type::End, "", 0.0 });
+    }
+
+    const Token& peek() const {
+        return tokens[pos];
+    }
+
+    bool acceptWord(const char* word) {
+        if (peek().type == Token::Type::Word && peek().text == word) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool acceptSymbol(const char* symbol) {
+        if (peek().type == Token::Type::Symbol && peek().text == symbol) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expectWord(const char* word) {
+        if (!acceptWord(word)) throw QueryException(string("ожидалось ") + word);
+    }
+
+    void expectSymbol(const char* symbol) {
+        if (!acceptSymbol(symbol)) throw QueryException(string("ожидался символ '") + symbol + "'");
+    }
+
+    QueryColumn parseColumn() {
+        QueryColumn column;
+        if (peek().type != Token::Type::Word || !parseQueryColumn(peek().text, column)) {
+            throw QueryException("ожидался столбец, найдено '" + peek().text + "'");
+        }
+        ++pos;
+        return column;
+    }
+
+    QuerySelectItem parseSelectItem() {
+        static const pair<const char*, QueryAggregate> aggregates[] = {
+            { "count", QueryAggregate::Count }, { "sum", QueryAggregate::Sum }, { "avg", QueryAggregate::Avg },
+            { "min", QueryAggregate::Min }, { "max", QueryAggregate::Max }
+        };
+        QuerySelectItem item;
+        for (const auto& a : aggregates) {
+            if (peek().type == Token::Type::Word && peek().text == a.first &&
+                tokens[pos + 1].type == Token::Type::Symbol && tokens[pos + 1].text == "(") {
+                pos += 2;
+                item.aggregate = a.second;
+                if (a.second == QueryAggregate::Count && acceptSymbol("*")) {
+                    item.countStar = true;
+                    item.text = "count(*)";
+                }
+                else {
+                    item.column = parseColumn();
+                    if (item.column == QueryColumn::Number && a.second != QueryAggregate::Count) {
+                        throw QueryException(string(a.first) + " неприменим к текстовому столбцу number");
+                    }
+                    item.text = string(a.first) + "(" + queryColumnName(item.column) + ")";
+                }
+                expectSymbol(")");
+                return item;
+            }
+        }
+        item.column = parseColumn();
+        item.text = queryColumnName(item.column);
+        return item;
+    }
+
+    unique_ptr<QueryPredicate> parseOr() {
+        unique_ptr<QueryPredicate> left = parseAnd();
+        while (acceptWord("or")) {
+            unique_ptr<QueryPredicate> node(new QueryPredicate());
+            node->kind = QueryPredicate::Kind::Or;
+            node->left = move(left);
+            node->right = parseAnd();
+            left = move(node);
+        }
+        return left;
+    }
+
+    unique_ptr<QueryPredicate> parseAnd() {
+        unique_ptr<QueryPredicate> left = parseNot();
+        while (acceptWord("and")) {
+            unique_ptr<QueryPredicate> node(new QueryPredicate());
+            node->kind = QueryPredicate::Kind::And;
+            node->left = move(left);
+            node->right = parseNot();
+            left = move(node);
+        }
+        return left;
+    }
+
+    unique_ptr<QueryPredicate> parseNot() {
+        if (acceptWord("not")) {
+            unique_ptr<QueryPredicate> node(new QueryPredicate());
+            node->kind = QueryPredicate::Kind::Not;
+            node->left = parseNot();
+            return node;
+        }
+        if (acceptSymbol("(")) {
+            unique_ptr<QueryPredicate> inner = parseOr();
+            expectSymbol(")");
+            return inner;
+        }
+        return parseComparison();
+    }
+
+    unique_ptr<QueryPredicate> parseComparison() {
+        unique_ptr<QueryPredicate> node(new QueryPredicate());
+        node->column = parseColumn();
+        if (acceptWord("like")) {
+            if (node->column != QueryColumn::Number || peek().type != Token::Type::String) {
+                throw QueryException("LIKE применяется к number со строковым шаблоном");
+            }
+            node->kind = QueryPredicate::Kind::Like;
+            node->text = peek().text;
+            ++pos;
+            return node;
+        }
+
+        static const pair<const char*, CompareOp> ops[] = {
+            { "=", CompareOp::Eq }, { "!=", CompareOp::Ne }, { "<>", CompareOp::Ne }, { "<", CompareOp::Lt },
+            { "<=", CompareOp::Le }, { ">", CompareOp::Gt }, { ">=", CompareOp::Ge }
+        };
+        bool found = false;
+        for (const auto& op : ops) {
+            if (acceptSymbol(op.first)) {
+                node->op = op.second;
+                found = true;
+                break;
+            }
+        }
+        if (!found) throw QueryException("ожидался оператор сравнения");
+
+        if (peek().type == Token::Type::Number) {
+            if (node->column == QueryColumn::Number) throw QueryException("number сравнивается со строкой в кавычках");
+            node->number = peek().number;
+        }
+        else if (peek().type == Token::Type::String) {
+            if (node->column != QueryColumn::Number) throw QueryException("числовой столбец сравнивается с числом");
+            node->text = peek().text;
+            node->textLiteral = true;
+        }
+        else {
+            throw QueryException("ожидалось значение для сравнения");
+        }
+        ++pos;
+        return node;
+    }
+
+public:
+    ParsedQuery parse(const string& source) {
+        tokens.clear();
+        pos = 0;
+        tokenize(source);
+
+        ParsedQuery q;
+        expectWord("select");
+        if (acceptSymbol("*")) {
+            for (QueryColumn c : { QueryColumn::Number, QueryColumn::Base, QueryColumn::Final }) {
+                QuerySelectItem item;
+                item.column = c;
+                item.text = queryColumnName(c);
+                q.select.push_back(item);
+            }
+        }
+        else {
+            do {
+                q.select.push_back(parseSelectItem());
+            } while (acceptSymbol(","));
+        }
+        expectWord("from");
+        expectWord("rooms");
+        if (acceptWord("where")) {
+            q.where = parseOr();
+        }
+        if (acceptWord("group")) {
+            expectWord("by");
+            q.hasGroupBy = true;
+            q.groupBy = parseColumn();
+        }
+        if (acceptWord("order")) {
+            expectWord("by");
+            q.hasOrderBy = true;
+            q.orderBy = parseSelectItem().text;
+            if (acceptWord("desc")) q.orderDescending = true;
+            else acceptWord("asc");
+        }
+        if (acceptWord("limit")) {
+            const Token& t = peek();
+            size_t limit = 0;
+            auto parsed = from_chars(t.text.data(), t.text.data() + t.text.size(), limit);
+            if (t.type != Token::Type::Number || parsed.ec != errc() || parsed.ptr != t.text.data() + t.text.size()) {
+                throw QueryException("LIMIT ожидает неотрицательное целое число");
+            }
+            q.limit = limit;
+            ++pos;
+        }
+        if (peek().type != Token::Type::End) {
+            throw QueryException("лишний текст в конце запроса: '" + peek().text + "'");
+        }
+
+        bool anyAggregate = false;
+        for (const QuerySelectItem& item : q.select) {
+            if (item.aggregate != QueryAggregate::None) anyAggregate = true;
+        }
+        for (const QuerySelectItem& item : q.select) {
+            if (item.aggregate != QueryAggregate::None) continue;
+            if (q.hasGroupBy && item.column != q.groupBy) {
+                throw QueryException("столбец " + item.text + " должен быть в GROUP BY или в агрегате");
+            }
+            if (!q.hasGroupBy && anyAggregate) {
+                throw QueryException("нельзя смешивать столбцы и агрегаты без GROUP BY");
+            }
+        }
+        return q;
+    }
+};
+
+// Значение ячейки результата
+struct QueryValue {
+    bool isText = false;
+    bool integral = false;
+    double number = 0.0;
+    string text;
+
+    bool operator<(const QueryValue& other) const {
+        if (isText != other.isText) return isText < other.isText;
+        return isText ? text < other.text : number < other.number;
+    }
+};
+
+struct QueryResult {
+    vector<string> columns;
+    vector<vector<QueryValue>> rows;
+};
+
+// Шаги выполнения запроса, выбранные планировщиком
+struct QueryPlan {
+    enum class Access { FullScan, CostIndex, NumberPrefix };
+    Access access = Access::FullScan;
+    bool indexReady = false;        // полный индекс был готов; иначе адаптивный индекс (cost) или просмотр (number)
+    double costLow = -numeric_limits<double>::infinity();
+    double costHigh = numeric_limits<double>::infinity();
+    string prefix;
+    vector<const QueryPredicate*> residual;   // предикаты, проверяемые после доступа
+};
+
+// Статистика одного оператора для PROFILE
+struct QueryOperatorStats {
+    string name;
+    size_t rowsIn = 0;
+    size_t rowsOut = 0;
+    double milliseconds = 0.0;
+    size_t bytes = 0;          // память результата оператора и загруженных им столбцов
+    size_t allocations = 0;    // только при сборке с HOTEL_COUNT_ALLOCATIONS
+};
+
+string formatQueryNumber(double value) {
+    ostringstream out;
+    out << value;
+    return out.str();
+}
+
+string describePredicate(const QueryPredicate& p) {
+    static const char* ops[] = { "=", "!=", "<", "<=", ">", ">=" };
+    switch (p.kind) {
+    case QueryPredicate::Kind::And: return "(" + describePredicate(*p.left) + " AND " + describePredicate(*p.right) + ")";
+    case QueryPredicate::Kind::Or: return "(" + describePredicate(*p.left) + " OR " + describePredicate(*p.right) + ")";
+    case QueryPredicate::Kind::Not: return "NOT " + describePredicate(*p.left);
+    case QueryPredicate::Kind::Like: return string(queryColumnName(p.column)) + " LIKE '" + p.text + "'";
+    default: break;
+    }
+    string value = p.textLiteral ? "'" + p.text + "'" : formatQueryNumber(p.number);
+    return string(queryColumnName(p.column)) + " " + ops[static_cast<int>(p.op)] + " " + value;
+}
+
+string describeAccess(const QueryPlan& plan) {
+    string status = plan.indexReady ? "" : " (индекс строится, просмотр всех номеров)";
+    switch (plan.access) {
+    case QueryPlan::Access::CostIndex:
+        return (plan.indexReady ? "Индекс стоимости" : "Адаптивный индекс стоимости") + string(": final в [") +
+            formatQueryNumber(plan.costLow) + ", " + formatQueryNumber(plan.costHigh) + "]";
+    case QueryPlan::Access::NumberPrefix:
+        return "Индекс обозначений: number LIKE '" + plan.prefix + "%'" + status;
+    default:
+        return "Полный просмотр rooms";
+    }
+}
+
+bool likeMatches(const char* text, const char* pattern) {
+    // % - любая последовательность, _ - один символ
+    while (*pattern) {
+        if (*pattern == '%') {
+            ++pattern;
+            if (!*pattern) return true;
+            for (const char* t = text; *t; ++t) {
+                if (likeMatches(t, pattern)) return true;
+            }
+            return false;
+        }
+        if (!*text || (*pattern != '_' && *pattern != *text)) return false;
+        ++text;
+        ++pattern;
+    }
+    return !*text;
+}
+
+class QueryExecutor {
+private:
+    const Hotel& hotel;
+    size_t rowCount;
+
+    // столбцы материализуются при первом обращении
+    vector<double> numericColumns[6];
+    bool numericReady[6] = {};
+    vector<string_view> numbers;
+    bool numbersReady = false;
+
+    const vector<double>& numeric(QueryColumn column) {
+        int c = static_cast<int>(column);
+        if (!numericReady[c]) {
+            vector<double>& col = numericColumns[c];
+            switch (column) {
+            case QueryColumn::Base: col = hotel.getBaseCosts(); break;
+            case QueryColumn::Final: col = hotel.getFinalCosts(); break;
+            case QueryColumn::Total: col = hotel.getTotalCosts(); break;
+            case QueryColumn::Discount: {
+                const vector<double>& base = numeric(QueryColumn::Base);
+                const vector<double>& finals = numeric(QueryColumn::Final);
+                col.resize(rowCount);
+                for (size_t i = 0; i < rowCount; ++i) col[i] = discountPercentOf(base[i], finals[i]);
+                break;
+            }
+            case QueryColumn::Floor: {
+                col.resize(rowCount);
+                for (size_t i = 0; i < rowCount; ++i) col[i] = floorOfRoomNumber(hotel.roomAt(i).getNumber());
+                break;
+            }
+            default: break;
+            }
+            numericReady[c] = true;
+        }
+        return numericColumns[c];
+    }
+
+    const vector<string_view>& text() {
+        if (!numbersReady) {
+            numbers.resize(rowCount);
+            for (size_t i = 0; i < rowCount; ++i) numbers[i] = hotel.roomAt(i).getNumber();
+            numbersReady = true;
+        }
+        return numbers;
+    }
+
+    QueryValue valueAt(QueryColumn column, uint32_t row) {
+        QueryValue v;
+        if (column == QueryColumn::Number) {
+            v.isText = true;
+            v.text = hotel.roomAt(row).getNumber();
+        }
+        else {
+            v.number = numeric(column)[row];
+            v.integral = column == QueryColumn::Floor;
+        }
+        return v;
+    }
+
+    template <typename T, typename Test>
+    static vector<uint32_t> filter(const vector<uint32_t>& input, const vector<T>& column, Test test) {
+        vector<uint32_t> out;
+        out.reserve(input.size());
+        for (uint32_t i : input) {
+            if (test(column[i])) out.push_back(i);
+        }
+        return out;
+    }
+
+    template <typename T>
+    static bool compare(const T& a, CompareOp op, const T& b) {
+        switch (op) {
+        case CompareOp::Eq: return a == b;
+        case CompareOp::Ne: return !(a == b);
+        case CompareOp::Lt: return a < b;
+        case CompareOp::Le: return !(b < a);
+        case CompareOp::Gt: return b < a;
+        case CompareOp::Ge: return !(a < b);
+        }
+        return false;
+    }
+
+    vector<uint32_t> evaluate(const QueryPredicate& p, const vector<uint32_t>& input) {
+        switch (p.kind) {
+        case QueryPredicate::Kind::And:
+            return evaluate(*p.right, evaluate(*p.left, input));
+        case QueryPredicate::Kind::Or: {
+            vector<uint32_t> a = evaluate(*p.left, input);
+            vector<uint32_t> b = evaluate(*p.right, input);
+            vector<uint32_t> out;
+            set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(out));
+            return out;
+        }
+        case QueryPredicate::Kind::Not: {
+            vector<uint32_t> excluded = evaluate(*p.left, input);
+            vector<uint32_t> out;
+            set_difference(input.begin(), input.end(), excluded.begin(), excluded.end(), back_inserter(out));
+            return out;
+        }
+        case QueryPredicate::Kind::Like: {
+            const char* pattern = p.text.c_str();
+            vector<uint32_t> out;
+            for (uint32_t i : input) {
+                if (likeMatches(hotel.roomAt(i).getNumber().c_str(), pattern)) out.push_back(i);
+            }
+            return out;
+        }
+        default:
+            if (p.column == QueryColumn::Number) {
+                string_view value(p.text);
+                return filter(input, text(), [&](string_view s) { return compare(s, p.op, value); });
+            }
+            double value = p.number;
+            CompareOp op = p.op;
+            return filter(input, numeric(p.column), [=](double x) { return compare(x, op, value); });
+        }
+    }
+
+    static void collectConjuncts(const QueryPredicate* p, vector<const QueryPredicate*>& out) {
+        if (!p) return;
+        if (p->kind == QueryPredicate::Kind::And) {
+            collectConjuncts(p->left.get(), out);
+            collectConjuncts(p->right.get(), out);
+        }
+        else {
+            out.push_back(p);
+        }
+    }
+
+    // Замер одного оператора для PROFILE: время, строки на входе и выходе,
+    // память результата оператора и впервые материализованных им столбцов
+    class OperatorProbe {
+    private:
+        QueryExecutor& owner;
+        chrono::steady_clock::time_point start;
+        size_t columnBytesAtStart;
+        size_t allocationsAtStart;
+
+    public:
+        explicit OperatorProbe(QueryExecutor& owner_)
+            : owner(owner_), start(chrono::steady_clock::now()),
+              columnBytesAtStart(owner_.columnBytes()), allocationsAtStart(allocationCount()) {
+        }
+
+        void finish(const string& name, size_t rowsIn, size_t rowsOut, size_t bytes) {
+            if (!owner.profile) return;
+            QueryOperatorStats s;
+            s.name = name;
+            s.rowsIn = rowsIn;
+            s.rowsOut = rowsOut;
+            s.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            s.bytes = bytes + (owner.columnBytes() - columnBytesAtStart);
+            s.allocations = allocationCount() - allocationsAtStart;
+            owner.profile->push_back(s);
+        }
+    };
+
+    vector<QueryOperatorStats>* profile = nullptr;
+
+    size_t columnBytes() const {
+        size_t total = numbers.capacity() * sizeof(string_view);
+        for (const vector<double>& c : numericColumns) total += c.capacity() * sizeof(double);
+        return total;
+    }
+
+    static size_t resultBytes(const QueryResult& result) {
+        size_t total = 0;
+        for (const vector<QueryValue>& row : result.rows) {
+            total += row.capacity() * sizeof(QueryValue);
+            for (const QueryValue& v : row) total += v.text.capacity();
+        }
+        return total;
+    }
+
+    static bool isCostRange(const QueryPredicate* p) {
+        return p->kind == QueryPredicate::Kind::Compare && p->column == QueryColumn::Final && p->op != CompareOp::Ne;
+    }
+
+    static bool isPrefixLike(const QueryPredicate* p) {
+        if (p->kind != QueryPredicate::Kind::Like || p->text.empty() || p->text.back() != '%') return false;
+        string head = p->text.substr(0, p->text.size() - 1);
+        return !head.empty() && head.find_first_of("%_") == string::npos;
+    }
+
+public:
+    explicit QueryExecutor(const Hotel& hotel_)
+        : hotel(hotel_), rowCount(hotel_.size()) {
+    }
+
+    // при заданном векторе каждый оператор добавляет в него свою статистику
+    void setProfile(vector<QueryOperatorStats>* stats) {
+        profile = stats;
+    }
+
+    // Выбор пути доступа: диапазон по final через индекс стоимости, затем
+    // префикс номера через индекс обозначений, иначе полный просмотр
+    QueryPlan plan(const ParsedQuery& q) {
+        QueryPlan plan;
+        vector<const QueryPredicate*> conjuncts;
+        collectConjuncts(q.where.get(), conjuncts);
+
+        bool anyRange = false;
+        for (const QueryPredicate* p : conjuncts) {
+            if (isCostRange(p)) anyRange = true;
+        }
+        if (anyRange) {
+            plan.access = QueryPlan::Access::CostIndex;
+            plan.indexReady = hotel.isCostIndexReady();
+            for (const QueryPredicate* p : conjuncts) {
+                if (!isCostRange(p)) {
+                    plan.residual.push_back(p);
+                    continue;
+                }
+                double v = p->number;
+                switch (p->op) {
+                case CompareOp::Eq: plan.costLow = max(plan.costLow, v); plan.costHigh = min(plan.costHigh, v); break;
+                case CompareOp::Lt: plan.costHigh = min(plan.costHigh, nextafter(v, -numeric_limits<double>::infinity())); break;
+                case CompareOp::Le: plan.costHigh = min(plan.costHigh, v); break;
+                case CompareOp::Gt: plan.costLow = max(plan.costLow, nextafter(v, numeric_limits<double>::infinity())); break;
+                case CompareOp::Ge: plan.costLow = max(plan.costLow, v); break;
+                default: break;
+                }
+            }
+            return plan;
+        }
+
+        for (size_t i = 0; i < conjuncts.size(); ++i) {
+            if (plan.access == QueryPlan::Access::FullScan && isPrefixLike(conjuncts[i])) {
+                plan.access = QueryPlan::Access::NumberPrefix;
+                plan.indexReady = hotel.isNumberIndexReady();
+                plan.prefix = conjuncts[i]->text.substr(0, conjuncts[i]->text.size() - 1);
+            }
+            else {
+                plan.residual.push_back(conjuncts[i]);
+            }
+        }
+        return plan;
+    }
+
+    // позиции строк, прошедших WHERE, по возрастанию
+    vector<uint32_t> select(const QueryPlan& plan) {
+        OperatorProbe probe(*this);
+        vector<uint32_t> rows;
+        if (plan.access == QueryPlan::Access::FullScan) {
+            rows.resize(rowCount);
+            for (size_t i = 0; i < rowCount; ++i) rows[i] = static_cast<uint32_t>(i);
+        }
+        else {
+            vector<size_t> candidates = plan.access == QueryPlan::Access::CostIndex
+                ? (plan.costLow <= plan.costHigh ? hotel.findByCostRange(plan.costLow, plan.costHigh) : vector<size_t>())
+                : hotel.findByPrefix(plan.prefix);
+            rows.assign(candidates.begin(), candidates.end());
+            sort(rows.begin(), rows.end());
+        }
+        // без готового индекса префиксы ищутся просмотром всех номеров, а
+        // адаптивный индекс стоимости просматривает разбитые им куски
+        size_t scanned = rowCount;
+        if (plan.access != QueryPlan::Access::FullScan && plan.indexReady) scanned = rows.size();
+        else if (plan.access == QueryPlan::Access::CostIndex) scanned = hotel.getCostCrackTouched() + rows.size();
+        probe.finish(describeAccess(plan), scanned, rows.size(), rows.capacity() * sizeof(uint32_t));
+
+        for (const QueryPredicate* p : plan.residual) {
+            OperatorProbe filterProbe(*this);
+            size_t before = rows.size();
+            rows = evaluate(*p, rows);
+            filterProbe.finish("Фильтр " + describePredicate(*p), before, rows.size(), rows.capacity() * sizeof(uint32_t));
+        }
+        return rows;
+    }
+
+    QueryResult project(const ParsedQuery& q, vector<uint32_t> rows) {
+        QueryResult result;
+        for (const QuerySelectItem& item : q.select) result.columns.push_back(item.text);
+
+        bool anyAggregate = false;
+        for (const QuerySelectItem& item : q.select) {
+            if (item.aggregate != QueryAggregate::None) anyAggregate = true;
+        }
+
+        if (!q.hasGroupBy && !anyAggregate) {
+            // ORDER BY по любому столбцу: сортируются позиции, затем LIMIT и проекция
+            if (q.hasOrderBy) {
+                OperatorProbe probe(*this);
+                QueryColumn column;
+                if (!parseQueryColumn(q.orderBy, column)) throw QueryException("ORDER BY " + q.orderBy + " без GROUP BY");
+                vector<pair<QueryValue, uint32_t>> keyed;
+                keyed.reserve(rows.size());
+                for (uint32_t r : rows) keyed.emplace_back(valueAt(column, r), r);
+                stable_sort(keyed.begin(), keyed.end(), [&](const pair<QueryValue, uint32_t>& a, const pair<QueryValue, uint32_t>& b) {
+                    return q.orderDescending ? b.first < a.first : a.first < b.first;
+                });
+                for (size_t k = 0; k < keyed.size(); ++k) rows[k] = keyed[k].second;
+                probe.finish(string("Сортировка по ") + q.orderBy + (q.orderDescending ? " DESC" : ""),
+                    rows.size(), rows.size(), keyed.capacity() * sizeof(pair<QueryValue, uint32_t>));
+            }
+            if (rows.size() > q.limit) {
+                OperatorProbe probe(*this);
+                size_t before = rows.size();
+                rows.resize(q.limit);
+                probe.finish("Лимит " + to_string(q.limit), before, rows.size(), 0);
+            }
+            OperatorProbe probe(*this);
+            for (uint32_t r : rows) {
+                vector<QueryValue> row;
+                for (const QuerySelectItem& item : q.select) row.push_back(valueAt(item.column, r));
+                result.rows.push_back(move(row));
+            }
+            probe.finish("Проекция", rows.size(), result.rows.size(), resultBytes(result));
+            return result;
+        }
+
+        // номера групп для отобранных строк; без GROUP BY одна группа
+        OperatorProbe groupProbe(*this);
+        vector<uint32_t> groupOf(rows.size(), 0);
+        vector<QueryValue> groupKeys;
+        if (q.hasGroupBy) {
+            map<QueryValue, uint32_t> ids;
+            for (size_t k = 0; k < rows.size(); ++k) {
+                QueryValue key = valueAt(q.groupBy, rows[k]);
+                auto it = ids.find(key);
+                if (it == ids.end()) {
+                    it = ids.emplace(key, static_cast<uint32_t>(groupKeys.size())).first;
+                    groupKeys.push_back(key);
+                }
+                groupOf[k] = it->second;
+            }
+        }
+        else {
+            groupKeys.resize(1);
+        }
+
+        // агрегаты считаются по одному элементу списка за проход
+        vector<vector<AggregateState>> states(q.select.size(), vector<AggregateState>(groupKeys.size()));
+        for (size_t s = 0; s < q.select.size(); ++s) {
+            const QuerySelectItem& item = q.select[s];
+            if (item.aggregate == QueryAggregate::None) continue;
+            vector<AggregateState>& st = states[s];
+            if (item.countStar || item.column == QueryColumn::Number) {
+                for (size_t k = 0; k < rows.size(); ++k) ++st[groupOf[k]].count;
+            }
+            else {
+                const vector<double>& column = numeric(item.column);
+                for (size_t k = 0; k < rows.size(); ++k) st[groupOf[k]].add(column[rows[k]]);
+            }
+        }
+
+        for (size_t g = 0; g < groupKeys.size(); ++g) {
+            vector<QueryValue> row;
+            for (size_t s = 0; s < q.select.size(); ++s) {
+                const QuerySelectItem& item = q.select[s];
+                const AggregateState& st = states[s][g];
+                QueryValue v;
+                bool empty = st.count == 0;
+                switch (item.aggregate) {
+                case QueryAggregate::None: v = groupKeys[g]; break;
+                case QueryAggregate::Count: v.number = static_cast<double>(st.count); v.integral = true; break;
+                case QueryAggregate::Sum: v.number = st.sum; break;
+                case QueryAggregate::Avg: v.number = empty ? NAN : st.average(); break;
+                case QueryAggregate::Min: v.number = empty ? NAN : st.min; break;
+                case QueryAggregate::Max: v.number = empty ? NAN : st.max; break;
+                }
+                row.push_back(v);
+            }
+            result.rows.push_back(move(row));
+        }
+        groupProbe.finish(q.hasGroupBy ? string("Группировка по ") + queryColumnName(q.groupBy) : string("Агрегация"),
+            rows.size(), result.rows.size(),
+            groupOf.capacity() * sizeof(uint32_t) + states.size() * groupKeys.size() * sizeof(AggregateState) + resultBytes(result));
+
+        if (q.hasOrderBy) {
+            OperatorProbe probe(*this);
+            size_t column = result.columns.size();
+            for (size_t c = 0; c < result.columns.size(); ++c) {
+                if (result.columns[c] == q.orderBy) column = c;
+            }
+            if (column == result.columns.size()) {
+                throw QueryException("ORDER BY " + q.orderBy + " должен быть в списке SELECT");
+            }
+            stable_sort(result.rows.begin(), result.rows.end(), [&](const vector<QueryValue>& a, const vector<QueryValue>& b) {
+                return q.orderDescending ? b[column] < a[column] : a[column] < b[column];
+            });
+            probe.finish(string("Сортировка по ") + q.orderBy + (q.orderDescending ? " DESC" : ""),
+                result.rows.size(), result.rows.size(), 0);
+        }
+        if (result.rows.size() > q.limit) {
+            OperatorProbe probe(*this);
+            size_t before = result.rows.size();
+            result.rows.resize(q.limit);
+            probe.finish("Лимит " + to_string(q.limit), before, result.rows.size(), 0);
+        }
+        return result;
+    }
+};
+
+QueryResult runQuery(const Hotel& hotel, const string& text) {
+    ParsedQuery q = QueryParser().parse(text);
+    QueryExecutor executor(hotel);
+    QueryPlan plan = executor.plan(q);
+    return executor.project(q, executor.select(plan));
+}
+
+void printQueryResult(const QueryResult& result, ostream& out) {
+    for (const string& c : result.columns) out << left << setw(16) << c;
+    out << '\n';
+    for (const vector<QueryValue>& row : result.rows) {
+        for (const QueryValue& v : row) {
+            if (v.isText) {
+                out << left << setw(16) << v.text;
+            }
+            else if (std::isnan(v.number)) {
+                out << left << setw(16) << "NULL";
+            }
+            else if (v.integral) {
+                out << left << setw(16) << static_cast<long long>(v.number);
+            }
+            else {
+                out << left << setw(16) << fixed << setprecision(2) << v.number;
+            }
+        }
+        out << '\n';
+    }
+    out << "(строк: " << result.rows.size() << ")\n";
+}
+
+void explainQuery(const ParsedQuery& q, const QueryPlan& plan, ostream& out) {
+    int step = 1;
+    out << "План запроса:\n";
+    out << "  " << step++ << ". " << describeAccess(plan) << '\n';
+    for (const QueryPredicate* p : plan.residual) {
+        out << "  " << step++ << ". Фильтр " << describePredicate(*p) << '\n';
+    }
+    bool anyAggregate = false;
+    string aggregates;
+    for (const QuerySelectItem& item : q.select) {
+        if (item.aggregate == QueryAggregate::None) continue;
+        anyAggregate = true;
+        aggregates += (aggregates.empty() ? "" : ", ") + item.text;
+    }
+    if (q.hasGroupBy) {
+        out << "  " << step++ << ". Группировка по " << queryColumnName(q.groupBy)
+            << (aggregates.empty() ? string() : ": " + aggregates) << '\n';
+    }
+    else if (anyAggregate) {
+        out << "  " << step++ << ". Агрегация: " << aggregates << '\n';
+    }
+    if (q.hasOrderBy) {
+        out << "  " << step++ << ". Сортировка по " << q.orderBy << (q.orderDescending ? " DESC" : "") << '\n';
+    }
+    if (q.limit != numeric_limits<size_t>::max()) {
+        out << "  " << step++ << ". Лимит " << q.limit << '\n';
+    }
+    if (!q.hasGroupBy && !anyAggregate) {
+        out << "  " << step++ << ". Проекция\n";
+    }
+}
+
+void printQueryProfile(const vector<QueryOperatorStats>& stats, ostream& out) {
+    bool allocations = allocationCountingEnabled();
+    double totalMs = 0.0;
+    size_t totalBytes = 0;
+    out << "Профиль запроса:\n";
+    // заголовки выровнены вручную: setw считает байты, а не буквы
+    out << "      вход     выход        мс  память, КБ";
+    if (allocations) out << " выделений";
+    out << "  оператор\n";
+    for (const QueryOperatorStats& s : stats) {
+        out << right << setw(10) << s.rowsIn << setw(10) << s.rowsOut
+            << setw(10) << fixed << setprecision(3) << s.milliseconds
+            << setw(12) << setprecision(1) << s.bytes / 1024.0;
+        if (allocations) out << setw(10) << s.allocations;
+        out << "  " << s.name << '\n';
+        totalMs += s.milliseconds;
+        totalBytes += s.bytes;
+    }
+    out << left << fixed << setprecision(3);
+    out << "Просмотрено строк: " << (stats.empty() ? 0 : stats.front().rowsIn)
+        << ", время: " << totalMs << " мс, память операторов: "
+        << setprecision(1) << totalBytes / 1024.0 << " КБ\n";
+}
+
+// Запрос, EXPLAIN <запрос> (план без выполнения) или PROFILE <запрос>
+// (выполнение с замером каждого оператора)
+void executeQueryCommand(const Hotel& hotel, const string& text, ostream& out) {
+    istringstream in(text);
+    string first;
+    in >> first;
+    for (char& ch : first) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    if (first != "explain" && first != "profile") {
+        printQueryResult(runQuery(hotel, text), out);
+        return;
+    }
+
+    string rest;
+    getline(in, rest, '\0');
+    ParsedQuery q = QueryParser().parse(rest);
+    QueryExecutor executor(hotel);
+    QueryPlan plan = executor.plan(q);
+    if (first == "explain") {
+        explainQuery(q, plan, out);
+        return;
+    }
+    vector<QueryOperatorStats> stats;
+    executor.setProfile(&stats);
+    QueryResult result = executor.project(q, executor.select(plan));
+    printQueryResult(result, out);
+    printQueryProfile(stats, out);
+}
+
+// ------------------- Валюты -------------------
+
+// Таблица курсов: сколько единиц валюты дают за единицу базовой валюты гостиницы.
+// Каждое изменение увеличивает версию, по которой сбрасываются кэши пересчёта.
+class CurrencyRateTable {
+private:
+    map<string, double> rates;
+    unsigned long long version = 0;
+
+public:
+    void setRate(const string& currency, double rate) {
+        if (currency.empty()) {
+            throw InvalidValueException("код валюты не может быть пустым");
+        }
+        if (rate <= 0.0) {
+            throw InvalidValueException("курс валюты должен быть > 0");
+        }
+        rates[currency] = rate;
+        ++version;
+    }
+
+    // Формат файла: "<код валюты> <курс>" в каждой строке, '#' - комментарий
+    void loadFromFile(const string& path) {
+        ifstream in(path);
+        if (!in) {
+            throw HotelException("не удалось открыть файл курсов '" + path + "'");
+        }
+        string line;
+        int lineNo = 0;
+        while (getline(in, line)) {
+            ++lineNo;
+            size_t start = line.find_first_not_of(" \t\r\n");
+            if (start == string::npos || line[start] == '#') continue;
+
+            istringstream ss(line);
+            string currency;
+            double rate = 0.0;
+            if (!(ss >> currency >> rate)) {
+                throw InvalidValueException("строка " + to_string(lineNo) + " файла курсов имеет неверный формат");
+            }
+            setRate(currency, rate);
+        }
+    }
+
+    double getRate(const string& currency) const {
+        auto it = rates.find(currency);
+        if (it == rates.end()) {
+            throw InvalidValueException("неизвестная валюта '" + currency + "'");
+        }
+        return it->second;
+    }
+
+    unsigned long long getVersion() const {
+        return version;
+    }
+
+    size_t size() const {
+        return rates.size();
+    }
+};
+
+// Итоговые цены гостиницы в других валютах. Пересчёт делается одним проходом
+// по столбцу итоговых стоимостей и кэшируется до изменения курсов или номеров.
+class HotelCurrencyView {
+private:
+    struct CachedColumn {
+        unsigned long long ratesVersion = 0;
+        unsigned long long hotelVersion = 0;
+        vector<double> values;
+    };
+
+    const Hotel& hotel;
+    const CurrencyRateTable& rates;
+    mutable map<string, CachedColumn> cache;
+
+public:
+    HotelCurrencyView(const Hotel& hotel_, const CurrencyRateTable& rates_)
+        : hotel(hotel_), rates(rates_) {
+    }
+
+    const vector<double>& getFinalCosts(const string& currency) const {
+        auto it = cache.find(currency);
+        if (it != cache.end() &&
+            it->second.ratesVersion == rates.getVersion() &&
+            it->second.hotelVersion == hotel.getVersion()) {
+            return it->second.values;
+        }
+
+        double rate = rates.getRate(currency);
+        const vector<double>& source = hotel.getFinalCosts();
+        CachedColumn& column = cache[currency];
+        column.values.resize(source.size());
+        vector<double>& values = column.values;
+        parallelFor(0, source.size(), kBulkGrain, [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; ++i) {
+                values[i] = source[i] * rate;
+            }
+        });
+        column.ratesVersion = rates.getVersion();
+        column.hotelVersion = hotel.getVersion();
+        return column.values;
+    }
+};
+
+// ------------------- Сеть гостиниц и NUMA -------------------
+
+// Размещение памяти и потоков по узлам NUMA. С libnuma (сборка с
+// -DHOTEL_HAVE_LIBNUMA -lnuma) память выделяется на заданном узле, а поток
+// закрепляется за узлом; без неё все функции работают как на одном узле.
+int numaNodeCount() {
+#ifdef HOTEL_HAVE_LIBNUMA
+    if (numa_available() >= 0) return numa_max_node() + 1;
+#endif
+    return 1;
+}
+
+double* numaAllocDoubles(size_t count, int node) {
+#ifdef HOTEL_HAVE_LIBNUMA
+    if (numa_available() >= 0) {
+        void* p = numa_alloc_onnode(max<size_t>(1, count) * sizeof(double), node);
+        if (!p) throw HotelException("не удалось выделить память на узле NUMA " + to_string(node));
+        return static_cast<double*>(p);
+    }
+#else
+    (void)node;
+#endif
+    return new double[max<size_t>(1, count)];
+}
+
+void numaFreeDoubles(double* p, size_t count) {
+#ifdef HOTEL_HAVE_LIBNUMA
+    if (numa_available() >= 0) {
+        numa_free(p, max<size_t>(1, count) * sizeof(double));
+        return;
+    }
+#else
+    (void)count;
+#endif
+    delete[] p;
+}
+
+// Закрепляет текущий поток за узлом NUMA до конца области видимости и
+// возвращает прежнюю привязку: потоки общего пула нельзя оставлять закреплёнными
+class NumaPinScope {
+private:
+#ifdef HOTEL_HAVE_LIBNUMA
+    bitmask* previous = nullptr;
+#endif
+
+public:
+    explicit NumaPinScope(int node) {
+#ifdef HOTEL_HAVE_LIBNUMA
+        if (numa_available() >= 0) {
+            previous = numa_get_run_node_mask();
+            numa_run_on_node(node);
+        }
+#else
+        (void)node;
+#endif
+    }
+
+    ~NumaPinScope() {
+#ifdef HOTEL_HAVE_LIBNUMA
+        if (previous) {
+            numa_run_on_node_mask(previous);
+            numa_bitmask_free(previous);
+        }
+#endif
+    }
+
+    NumaPinScope(const NumaPinScope&) = delete;
+    NumaPinScope& operator=(const NumaPinScope&) = delete;
+};
+
+// Копия столбца итоговых стоимостей одной гостиницы в памяти заданного узла
+class NumaPlacedColumn {
+private:
+    double* data = nullptr;
+    size_t count = 0;
+
+public:
+    NumaPlacedColumn(const vector<double>& source, int node)
+        : data(numaAllocDoubles(source.size(), node)), count(source.size())
+    {
+        copy(source.begin(), source.end(), data);
+    }
+
+    ~NumaPlacedColumn() {
+        numaFreeDoubles(data, count);
+    }
+
+    NumaPlacedColumn(const NumaPlacedColumn&) = delete;
+    NumaPlacedColumn& operator=(const NumaPlacedColumn&) = delete;
+
+    double sum() const {
+        double s = 0.0;
+        for (size_t i = 0; i < count; ++i) s += data[i];
+        return s;
+    }
+};
+
+// Сеть гостиниц: каждая гостиница - отдельный шард. Для сетевых просмотров
+// столбцы шардов размещаются по узлам NUMA по кругу, а шард просматривается
+// задачей общего пула, которая на время просмотра закрепляется за его узлом.
+class HotelChain {
+private:
+    struct Shard {
+        unique_ptr<Hotel> hotel;
+        unique_ptr<NumaPlacedColumn> placed;
+        unsigned long long placedVersion = ~0ULL;
+    };
+
+    vector<Shard> shards;
+    bool numaPlacement = true;
+
+    void refreshPlacement() {
+        int nodes = numaNodeCount();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            Shard& s = shards[i];
+            if (s.placedVersion != s.hotel->getVersion()) {
+                s.placed.reset(new NumaPlacedColumn(s.hotel->getFinalCosts(), static_cast<int>(i % nodes)));
+                s.placedVersion = s.hotel->getVersion();
+            }
+        }
+    }
+
+public:
+    Hotel& addProperty() {
+        shards.emplace_back();
+        shards.back().hotel.reset(new Hotel());
+        return *shards.back().hotel;
+    }
+
+    Hotel& property(size_t i) {
+        return *shards.at(i).hotel;
+    }
+
+    size_t size() const {
+        return shards.size();
+    }
+
+    void setNumaPlacement(bool enabled) {
+        numaPlacement = enabled;
+    }
+
+    size_t roomCount() const {
+        size_t n = 0;
+        for (const Shard& s : shards) n += s.hotel->getFinalCosts().size();
+        return n;
+    }
+
+    // скетчи всей сети - объединение скетчей гостиниц
+    HotelSketches sketches() const {
+        HotelSketches result;
+        for (const Shard& s : shards) result.merge(s.hotel->getSketches());
+        return result;
+    }
+
+    // средняя итоговая стоимость по всей сети
+    double calculateAverageCost() {
+        size_t rooms = roomCount();
+        if (rooms == 0) {
+            throw EmptyRoomListException("в сети нет номеров");
+        }
+
+        // без размещения те же потоки читают столбцы гостиниц там, где их
+        // разместил аллокатор, и не закрепляются за узлами
+        if (numaPlacement) {
+            refreshPlacement();
+        }
+        int nodes = numaNodeCount();
+        double sum = parallelReduce(0, shards.size(), 1, 0.0,
+            [&](size_t from, size_t to) {
+                double s = 0.0;
+                for (size_t i = from; i < to; ++i) {
+                    if (numaPlacement) {
+                        NumaPinScope pin(static_cast<int>(i % static_cast<size_t>(nodes)));
+                        s += shards[i].placed->sum();
+                    }
+                    else {
+                        for (double c : shards[i].hotel->getFinalCosts()) s += c;
+                    }
+                }
+                return s;
+            },
+            [](double a, double b) { return a + b; });
+        return sum / static_cast<double>(rooms);
+    }
+};
+
+// Замер пропускной способности сетевого просмотра с размещением по NUMA и без
+int runNumaBenchmark(size_t properties, size_t roomsPerProperty) {
+    HotelChain chain;
+    for (size_t p = 0; p < properties; ++p) {
+        vector<SnapshotRow> rows(roomsPerProperty);
+        for (size_t i = 0; i < roomsPerProperty; ++i) {
+            rows[i].number = to_string(i);
+            rows[i].baseCost = 1000.0 + static_cast<double>(i % 500);
+            rows[i].finalCost = rows[i].baseCost * 0.9;
+        }
+        chain.addProperty().loadSnapshot(rows);
+    }
+
+    const int kRepeats = 20;
+    cout << "Узлов NUMA: " << numaNodeCount() << ", гостиниц: " << properties
+        << ", номеров: " << chain.roomCount() << '\n';
+    for (int placed = 0; placed < 2; ++placed) {
+        chain.setNumaPlacement(placed != 0);
+        chain.calculateAverageCost();   // прогрев и размещение
+        auto start = chrono::steady_clock::now();
+        double avg = 0.0;
+        for (int r = 0; r < kRepeats; ++r) {
+            avg = chain.calculateAverageCost();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << (placed ? "с размещением по NUMA: " : "без размещения:        ")
+            << fixed << setprecision(1) << static_cast<double>(chain.roomCount()) * kRepeats / seconds / 1e6
+            << " млн номеров/с (средняя " << setprecision(2) << avg << ")\n";
+    }
+
+    auto start = chrono::steady_clock::now();
+    HotelSketches sketches = chain.sketches();
+    cout << "Скетчи сети за " << fixed << setprecision(1)
+        << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " мс:\n";
+    printHotelSketches(sketches);
+    return 0;
+}
+
+// ------------------- Репликация -------------------
+
+// Ведущий отдаёт последователям снимок и затем поток событий журнала
+// изменений через Unix-сокет. Протокол построчный:
+//   снимок в формате writeSnapshot
+//   E <seq> <add|update|remove> <длина>:<номер> <баз.стоимость> <итоговая стоимость>
+//   H <номер следующего события ведущего>        - пульс раз в 200 мс
+//   R                                            - дальше идёт новый снимок
+// Ведущий держит собственную копию строк, собранную из журнала, поэтому
+// его поток не обращается к Hotel и не мешает основному потоку. Если журнал
+// обогнал ведущего, копию пересобирает основной поток (resyncIfNeeded).
+#ifndef _WIN32
+
+sockaddr_un makeUnixAddress(const string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw InvalidValueException("слишком длинный путь сокета");
+    }
+    strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+class ReplicationLeader {
+private:
+    // исходящая очередь последователя; сокет неблокирующий, поэтому
+    // отставший последователь копит очередь, а не останавливает ведущего
+    struct FollowerLink {
+        int fd;
+        string pending;
+        size_t sent = 0;
+        bool hasSnapshot = false;
+    };
+
+    // сколько байт событий может ждать отправки, прежде чем последователь отключается
+    static const size_t kMaxFollowerBacklog = 64u << 20;
+
+    ChangeEventRing& ring;
+    int subscriberId;
+    string socketPath;
+    int listenFd;
+    vector<FollowerLink> followers;
+    atomic<bool> stopping{ false };
+    thread worker;
+
+    // копия состояния гостиницы на момент nextSequence
+    vector<SnapshotRow> rows;
+    unordered_map<string, size_t> rowIndex;
+    unsigned long long nextSequence;
+    bool diverged;
+
+    // пересинхронизация: поток ведущего отмечает пропуск, основной поток
+    // (владелец гостиницы) кладёт свежий снимок, поток ведущего его забирает
+    mutex pollMutex;                     // держится, пока поток ведущего разбирает события
+    atomic<bool> resyncRequested{ false };
+    mutex resyncMutex;
+    atomic<bool> resyncReady{ false };
+    vector<SnapshotRow> resyncRows;
+    unsigned long long resyncSequence;
+
+    void resetMirror(vector<SnapshotRow> snapshot, unsigned long long sequence) {
+        rows = std::move(snapshot);
+        rowIndex.clear();
+        rowIndex.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            rowIndex[rows[i].number] = i;
+        }
+        nextSequence = sequence;
+        diverged = false;
+    }
+
+    // удаление меняет порядок строк (последняя встаёт на место удалённой),
+    // зато каждое событие обходится в O(1)
+    void applyToMirror(const RoomChangeEvent& e) {
+        nextSequence = e.sequence + 1;
+        auto it = rowIndex.find(e.number);
+        if (e.kind == RoomChangeKind::Removed) {
+            if (it == rowIndex.end()) return;
+            size_t pos = it->second;
+            rowIndex.erase(it);
+            if (pos + 1 != rows.size()) {
+                rows[pos] = std::move(rows.back());
+                rowIndex[rows[pos].number] = pos;
+            }
+            rows.pop_back();
+        }
+        else if (it != rowIndex.end()) {
+            rows[it->second].baseCost = e.baseCost;
+            rows[it->second].finalCost = e.finalCost;
+        }
+        else {
+            rowIndex.emplace(e.number, rows.size());
+            rows.push_back({ e.number, e.baseCost, e.finalCost });
+        }
+    }
+
+    string snapshotText() const {
+        ostringstream snapshot;
+        writeSnapshot(snapshot, nextSequence, rows);
+        return snapshot.str();
+    }
+
+    void installResync() {
+        if (!resyncReady.load(memory_order_acquire)) return;
+        {
+            lock_guard<mutex> lock(resyncMutex);
+            resyncReady.store(false, memory_order_relaxed);
+            resetMirror(std::move(resyncRows), resyncSequence);
+            resyncRows.clear();
+        }
+        // последователи со старым снимком получают "R" и новый снимок
+        string snapshot = snapshotText();
+        for (FollowerLink& link : followers) {
+            if (link.hasSnapshot) {
+                link.pending += "R\n";
+            }
+            link.pending += snapshot;
+            link.hasSnapshot = true;
+        }
+    }
+
+    // false - сокет сломан и последователя нужно отключить
+    static bool flush(FollowerLink& link) {
+        while (link.sent < link.pending.size()) {
+            ssize_t n = send(link.fd, link.pending.data() + link.sent, link.pending.size() - link.sent,
+                MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+            if (n <= 0) return false;
+            link.sent += static_cast<size_t>(n);
+        }
+        if (link.sent == link.pending.size()) {
+            link.pending.clear();
+            link.sent = 0;
+        }
+        else if (link.sent > link.pending.size() / 2) {
+            link.pending.erase(0, link.sent);
+            link.sent = 0;
+        }
+        return true;
+    }
+
+    void run() {
+        auto lastHeartbeat = chrono::steady_clock::now();
+        RoomChangeEvent e;
+        while (!stopping.load(memory_order_acquire)) {
+            bool busy = false;
+            int fd;
+            while ((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                FollowerLink link;
+                link.fd = fd;
+                followers.push_back(std::move(link));
+                busy = true;
+            }
+
+            ostringstream batch;
+            batch << setprecision(17);
+            bool any = false;
+            {
+                lock_guard<mutex> lock(pollMutex);
+                installResync();
+                if (!diverged) {
+                    string snapshot;
+                    for (FollowerLink& link : followers) {
+                        if (link.hasSnapshot) continue;
+                        if (snapshot.empty()) snapshot = snapshotText();
+                        link.pending += snapshot;
+                        link.hasSnapshot = true;
+                    }
+                }
+                while (ring.poll(subscriberId, e)) {
+                    busy = true;
+                    // снимок основного потока появляется раньше любого события после него,
+                    // поэтому всё, что прочитано до его появления, в снимок уже вошло
+                    installResync();
+                    if (diverged || e.sequence < nextSequence) continue;
+                    if (e.sequence != nextSequence) {
+                        cerr << "Репликация: пропущены события " << nextSequence << ".." << e.sequence - 1
+                            << ", копия будет пересобрана по гостинице\n";
+                        diverged = true;
+                        resyncRequested.store(true, memory_order_release);
+                        continue;
+                    }
+                    if (e.kind == RoomChangeKind::TypeRepriced) {
+                        // строки копии не знают типов номеров: копию пересобирает основной поток
+                        nextSequence = e.sequence + 1;
+                        diverged = true;
+                        resyncRequested.store(true, memory_order_release);
+                        continue;
+                    }
+                    applyToMirror(e);
+                    batch << "E " << e.sequence << ' ' << changeKindName(e.kind) << ' ';
+                    writeSnapshotRow(batch, e.number, e.baseCost, e.finalCost);
+                    any = true;
+                }
+            }
+            auto now = chrono::steady_clock::now();
+            if (!diverged && now - lastHeartbeat >= chrono::milliseconds(200)) {
+                batch << "H " << nextSequence << '\n';
+                lastHeartbeat = now;
+                any = true;
+            }
+
+            string data = any ? batch.str() : string();
+            for (size_t i = 0; i < followers.size();) {
+                FollowerLink& link = followers[i];
+                if (link.hasSnapshot && !data.empty()) {
+                    link.pending += data;
+                }
+                bool alive = link.pending.size() - link.sent <= kMaxFollowerBacklog || !link.hasSnapshot;
+                if (alive && !link.pending.empty()) {
+                    size_t before = link.sent;
+                    alive = flush(link);
+                    busy = busy || link.sent != before;
+                }
+                if (alive) {
+                    ++i;
+                }
+                else {
+                    close(link.fd);
+                    followers.erase(followers.begin() + i);
+                }
+            }
+            if (!busy) {
+                this_thread::sleep_for(chrono::milliseconds(5));
+            }
+        }
+    }
+
+public:
+    // конструктор вызывается в потоке, владеющем гостиницей: снимок и подписка
+    // делаются в одной точке, поэтому поток событий продолжает снимок без разрывов
+    ReplicationLeader(Hotel& hotel, const string& path)
+        : ring(hotel.getChangeStream()), subscriberId(-1), socketPath(path), listenFd(-1),
+        nextSequence(0), diverged(false), resyncSequence(0)
+    {
+        sockaddr_un addr = makeUnixAddress(path);
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            throw HotelException("не удалось создать сокет репликации");
+        }
+        unlink(path.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listenFd, 8) != 0) {
+            close(listenFd);
+            throw HotelException("не удалось открыть сокет репликации '" + path + "': " + strerror(errno));
+        }
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL, 0) | O_NONBLOCK);
+
+        subscriberId = ring.subscribe();
+        resetMirror(hotel.snapshotRows(), ring.getHead());
+        worker = thread(&ReplicationLeader::run, this);
+    }
+
+    ~ReplicationLeader() {
+        stopping.store(true, memory_order_release);
+        if (worker.joinable()) worker.join();
+        ring.unsubscribe(subscriberId);
+        for (const FollowerLink& link : followers) close(link.fd);
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+
+    ReplicationLeader(const ReplicationLeader&) = delete;
+    ReplicationLeader& operator=(const ReplicationLeader&) = delete;
+
+    // вызывается основным потоком после каждой операции над гостиницей: если
+    // ведущий отстал от журнала больше чем на буфер или встретил событие,
+    // которое копия не может применить, его копия пересобирается по текущему
+    // состоянию гостиницы. Пока ведущий не разобрал события операции,
+    // основной поток ждёт (не дольше одного круга потока ведущего).
+    void resyncIfNeeded(const Hotel& hotel) {
+        bool needed = false;
+        while (true) {
+            unique_lock<mutex> lock(pollMutex);
+            bool lapped = ring.isLapped(subscriberId);
+            if (lapped || ring.isCaughtUp(subscriberId)) {
+                needed = resyncRequested.exchange(false, memory_order_acq_rel) || lapped;
+                break;
+            }
+            lock.unlock();
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (!needed) return;
+        vector<SnapshotRow> snapshot = hotel.snapshotRows();
+        lock_guard<mutex> resyncLock(resyncMutex);
+        resyncRows = std::move(snapshot);
+        resyncSequence = ring.getHead();
+        resyncReady.store(true, memory_order_release);
+    }
+};
+
+// Последователь: держит реплику гостиницы и обслуживает запросы на чтение.
+// Номера реплики хранят итоговую стоимость ведущего (FixedCostStrategy).
+class ReplicationFollower {
+private:
+    Hotel replica;
+    mutable mutex replicaMutex;
+    int fd;
+    atomic<bool> stopping{ false };
+    atomic<bool> connected{ false };
+    atomic<unsigned long long> appliedSequence{ 0 };   // номер следующего ожидаемого события
+    atomic<unsigned long long> leaderSequence{ 0 };
+    atomic<long long> lastHeartbeatMs{ 0 };
+    thread worker;
+
+    static long long nowMs() {
+        return chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void applyEvent(unsigned long long sequence, const string& kind, const SnapshotRow& row) {
+        if (sequence < appliedSequence.load()) return;   // уже входит в снимок
+        lock_guard<mutex> lock(replicaMutex);
+        if (kind == "remove") {
+            replica.removeRoom(row.number);
+        }
+        else if (kind == "update") {
+            replica.updateRoom(row.number, row.baseCost, make_shared<FixedCostStrategy>(row.finalCost));
+        }
+        else {
+            replica.addRoom(row.number, row.baseCost, make_shared<FixedCostStrategy>(row.finalCost));
+        }
+        appliedSequence.store(sequence + 1);
+    }
+
+    // Буфер разбирается с позиции consumed и сжимается один раз на recv;
+    // пока ждём снимок, переводы строк считаются только в новых байтах
+    void run() {
+        string buffer;
+        size_t consumed = 0;
+        size_t scanned = 0;
+        size_t newlines = 0;
+        size_t snapshotLines = 0;       // строк в ожидаемом снимке вместе с заголовком
+        bool haveSnapshot = false;
+        char chunk[4096];
+        while (!stopping.load()) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) break;
+            buffer.append(chunk, static_cast<size_t>(n));
+
+            try {
+                while (true) {
+                    if (!haveSnapshot) {
+                        // снимок разбирается, только когда пришли заголовок и все его строки
+                        for (; scanned < buffer.size(); ++scanned) {
+                            if (buffer[scanned] == '\n') ++newlines;
+                        }
+                        if (newlines == 0) break;
+                        if (snapshotLines == 0) {
+                            size_t headerEnd = buffer.find('\n', consumed);
+                            istringstream header(buffer.substr(consumed, headerEnd - consumed));
+                            string magic;
+                            int formatVersion = 0;
+                            unsigned long long headerSequence = 0;
+                            size_t count = 0;
+                            header >> magic >> formatVersion >> headerSequence >> count;
+                            snapshotLines = count + 1;
+                        }
+                        if (newlines < snapshotLines) break;
+
+                        istringstream in(buffer.substr(consumed));
+                        unsigned long long sequence = 0;
+                        vector<SnapshotRow> rows = readSnapshot(in, sequence);
+                        in.ignore(numeric_limits<streamsize>::max(), '\n');
+                        {
+                            lock_guard<mutex> lock(replicaMutex);
+                            replica.loadSnapshot(rows);
+                        }
+                        appliedSequence.store(sequence);
+                        leaderSequence.store(sequence);
+                        lastHeartbeatMs.store(nowMs());
+                        haveSnapshot = true;
+                        connected.store(true);
+                        streamoff used = in.tellg();
+                        consumed = used < 0 ? buffer.size() : consumed + static_cast<size_t>(used);
+                    }
+
+                    size_t eol = buffer.find('\n', consumed);
+                    if (eol == string::npos) break;
+                    istringstream line(buffer.substr(consumed, eol - consumed));
+                    consumed = eol + 1;
+                    char type = 0;
+                    line >> type;
+                    if (type == 'R') {
+                        // ведущий пересобрал копию: дальше идёт новый снимок
+                        haveSnapshot = false;
+                        scanned = consumed;
+                        newlines = 0;
+                        snapshotLines = 0;
+                    }
+                    else if (type == 'H') {
+                        unsigned long long head = 0;
+                        line >> head;
+                        leaderSequence.store(head);
+                        lastHeartbeatMs.store(nowMs());
+                    }
+                    else if (type == 'E') {
+                        unsigned long long sequence = 0;
+                        string kind;
+                        SnapshotRow row;
+                        line >> sequence >> kind;
+                        if (readSnapshotRow(line, row)) {
+                            applyEvent(sequence, kind, row);
+                            if (sequence + 1 > leaderSequence.load()) leaderSequence.store(sequence + 1);
+                        }
+                    }
+                }
+            }
+            catch (const HotelException& ex) {
+                cerr << "Репликация: " << ex.what() << '\n';
+            }
+            buffer.erase(0, consumed);
+            scanned = scanned > consumed ? scanned - consumed : 0;
+            consumed = 0;
+        }
+        connected.store(false);
+    }
+
+public:
+    explicit ReplicationFollower(const string& path)
+        : fd(-1)
+    {
+        sockaddr_un addr = makeUnixAddress(path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            if (fd >= 0) close(fd);
+            throw HotelException("не удалось подключиться к ведущему '" + path + "'");
+        }
+        worker = thread(&ReplicationFollower::run, this);
+    }
+
+    ~ReplicationFollower() {
+        stopping.store(true);
+        shutdown(fd, SHUT_RDWR);
+        if (worker.joinable()) worker.join();
+        close(fd);
+    }
+
+    ReplicationFollower(const ReplicationFollower&) = delete;
+    ReplicationFollower& operator=(const ReplicationFollower&) = delete;
+
+    double calculateAverageCost() const {
+        lock_guard<mutex> lock(replicaMutex);
+        return replica.calculateAverageCost();
+    }
+
+    void printAll() const {
+        lock_guard<mutex> lock(replicaMutex);
+        replica.printAll();
+    }
+
+    void query(const string& text, ostream& out) const {
+        lock_guard<mutex> lock(replicaMutex);
+        executeQueryCommand(replica, text, out);
+    }
+
+    void printLag() const {
+        if (!connected.load()) {
+            cout << "Нет соединения с ведущим.\n";
+            return;
+        }
+        unsigned long long leader = leaderSequence.load();
+        unsigned long long applied = appliedSequence.load();
+        cout << "Применено событий: " << applied << ", у ведущего: " << leader
+            << ", отставание: " << (leader > applied ? leader - applied : 0) << " событий, "
+            << (nowMs() - lastHeartbeatMs.load()) << " мс с последнего пульса\n";
     }
 };
 
+#endif
+
 // ------------------- Ввод / утилиты -------------------
 
 void clearStdin() {
@@ -260,6 +5639,24 @@ double inputNonNegativeDouble(const string& prompt) {
     }
 }
 
+double inputNonNegativeCost(const string& prompt) {
+    while (true) {
+        cout << prompt;
+        double x;
+        if (!(cin >> x)) {
+            cout << "Ошибка: введите число.\n";
+            clearStdin();
+            continue;
+        }
+        clearStdin();
+        if (x < 0.0) {
+            cout << "Ошибка: значение не может быть отрицательным. Попробуйте снова.\n";
+            continue;
+        }
+        return x;
+    }
+}
+
 int inputMenuChoice(const string& prompt, int low, int high) {
     while (true) {
         cout << prompt;
@@ -295,26 +5692,628 @@ int inputMenuChoice(const string& prompt, int low, int high) {
     }
 }
 
+// ------------------- Разделяемая память -------------------
+
+// Образ номеров гостиницы в сегменте POSIX shared memory для читателей из
+// других процессов. Раскладка без указателей, все ссылки - смещения от начала
+// сегмента:
+//   SharedHotelHeader
+//   double baseCosts[roomCount]
+//   double finalCosts[roomCount]
+//   uint32 numberOffsets[roomCount + 1]   - границы номеров в numberData
+//   char   numberData[]
+// Запись защищена seqlock: писатель делает sequence нечётным на время записи,
+// читатель повторяет запрос, если sequence был нечётным или изменился.
+#ifndef _WIN32
+
+struct SharedHotelHeader {
+    uint32_t magic;
+    uint32_t formatVersion;
+    atomic<uint64_t> sequence;
+    uint64_t capacityBytes;
+    uint64_t roomCount;
+    uint64_t baseCostsOffset;
+    uint64_t finalCostsOffset;
+    uint64_t numberOffsetsOffset;
+    uint64_t numberDataOffset;
+};
+
+const uint32_t kSharedHotelMagic = 0x48544C53;   // "SLTH"
+
+class SharedHotelSegment {
+protected:
+    string name;
+    int fd = -1;
+    unsigned char* base = nullptr;
+    size_t mappedSize = 0;
+
+    void map(size_t size, int protection) {
+        void* p = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            throw HotelException("не удалось отобразить сегмент '" + name + "': " + strerror(errno));
+        }
+        base = static_cast<unsigned char*>(p);
+        mappedSize = size;
+    }
+
+    void unmap() {
+        if (base) munmap(base, mappedSize);
+        base = nullptr;
+        mappedSize = 0;
+    }
+
+    // новое отображение создаётся до снятия старого: при ошибке старое
+    // остаётся рабочим, и заголовок сегмента можно привести в порядок
+    void remap(size_t size, int protection) {
+        void* p = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            throw HotelException("не удалось отобразить сегмент '" + name + "': " + strerror(errno));
+        }
+        unmap();
+        base = static_cast<unsigned char*>(p);
+        mappedSize = size;
+    }
+
+    SharedHotelHeader* header() const {
+        return reinterpret_cast<SharedHotelHeader*>(base);
+    }
+
+    explicit SharedHotelSegment(const string& name_)
+        : name(name_)
+    {
+        if (name.size() < 2 || name[0] != '/') {
+            throw InvalidValueException("имя сегмента должно начинаться с '/'");
+        }
+    }
+
+    ~SharedHotelSegment() {
+        unmap();
+        if (fd >= 0) close(fd);
+    }
+
+public:
+    SharedHotelSegment(const SharedHotelSegment&) = delete;
+    SharedHotelSegment& operator=(const SharedHotelSegment&) = delete;
+};
+
+// Писатель: переносит столбцы гостиницы в сегмент, когда меняется её версия
+class SharedHotelPublisher : public SharedHotelSegment {
+private:
+    unsigned long long publishedVersion = ~0ULL;
+
+    static size_t align8(size_t n) {
+        return (n + 7) & ~static_cast<size_t>(7);
+    }
+
+public:
+    explicit SharedHotelPublisher(const string& name_)
+        : SharedHotelSegment(name_)
+    {
+        fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            throw HotelException("не удалось создать сегмент '" + name + "': " + strerror(errno));
+        }
+        // сегмент мог остаться от прежнего писателя, и читатели могут держать
+        // его отображённым: уменьшать его нельзя (SIGBUS у читателей)
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            throw HotelException("не удалось получить размер сегмента '" + name + "'");
+        }
+        size_t existing = static_cast<size_t>(st.st_size);
+        size_t capacity = max(existing, static_cast<size_t>(64 * 1024));
+        if (capacity > existing && ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+            throw HotelException("не удалось задать размер сегмента '" + name + "'");
+        }
+        map(capacity, PROT_READ | PROT_WRITE);
+        SharedHotelHeader* h = header();
+        if (existing >= sizeof(SharedHotelHeader) && h->magic == kSharedHotelMagic && h->formatVersion == 1) {
+            // продолжаем последовательность прежнего писателя, чтобы читатели
+            // не приняли новый образ за тот, что они уже прочитали
+            uint64_t seq = h->sequence.load(memory_order_relaxed);
+            h->sequence.store((seq + 1) & ~static_cast<uint64_t>(1), memory_order_release);
+        }
+        else {
+            h = new (base) SharedHotelHeader();
+            h->magic = kSharedHotelMagic;
+            h->formatVersion = 1;
+            h->sequence.store(0, memory_order_relaxed);
+            h->roomCount = 0;
+            h->baseCostsOffset = h->finalCostsOffset = h->numberOffsetsOffset = h->numberDataOffset = sizeof(SharedHotelHeader);
+        }
+        h->capacityBytes = capacity;
+    }
+
+    ~SharedHotelPublisher() {
+        shm_unlink(name.c_str());
+    }
+
+    void publish(const Hotel& hotel) {
+        if (hotel.getVersion() == publishedVersion) return;
+
+        vector<SnapshotRow> rows = hotel.snapshotRows();
+        size_t n = rows.size();
+        size_t numberBytes = 0;
+        for (const SnapshotRow& r : rows) numberBytes += r.number.size();
+
+        size_t baseOff = align8(sizeof(SharedHotelHeader));
+        size_t finalOff = baseOff + n * sizeof(double);
+        size_t offsetsOff = finalOff + n * sizeof(double);
+        size_t dataOff = offsetsOff + (n + 1) * sizeof(uint32_t);
+        size_t needed = dataOff + numberBytes;
+
+        SharedHotelHeader* h = header();
+        uint64_t seq = h->sequence.load(memory_order_relaxed);
+        h->sequence.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        if (needed > mappedSize) {
+            size_t capacity = mappedSize;
+            while (capacity < needed) capacity *= 2;
+            if (ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+                h->sequence.store(seq + 2, memory_order_release);
+                throw HotelException("не удалось увеличить сегмент '" + name + "'");
+            }
+            try {
+                remap(capacity, PROT_READ | PROT_WRITE);
+            }
+            catch (...) {
+                // образ не менялся; чётный номер снова пускает читателей
+                h->sequence.store(seq + 2, memory_order_release);
+                throw;
+            }
+            h = header();
+            h->capacityBytes = capacity;
+        }
+
+        double* baseCosts = reinterpret_cast<double*>(base + baseOff);
+        double* finalCosts = reinterpret_cast<double*>(base + finalOff);
+        uint32_t* offsets = reinterpret_cast<uint32_t*>(base + offsetsOff);
+        char* data = reinterpret_cast<char*>(base + dataOff);
+        uint32_t pos = 0;
+        for (size_t i = 0; i < n; ++i) {
+            baseCosts[i] = rows[i].baseCost;
+            finalCosts[i] = rows[i].finalCost;
+            offsets[i] = pos;
+            memcpy(data + pos, rows[i].number.data(), rows[i].number.size());
+            pos += static_cast<uint32_t>(rows[i].number.size());
+        }
+        offsets[n] = pos;
+        h->roomCount = n;
+        h->baseCostsOffset = baseOff;
+        h->finalCostsOffset = finalOff;
+        h->numberOffsetsOffset = offsetsOff;
+        h->numberDataOffset = dataOff;
+
+        h->sequence.store(seq + 2, memory_order_release);
+        publishedVersion = hotel.getVersion();
+    }
+};
+
+// Читатель: отображает сегмент только для чтения и выполняет запросы прямо
+// по столбцам сегмента, без копирования всего образа
+class SharedHotelReader : public SharedHotelSegment {
+private:
+    // сколько номер последовательности может оставаться нечётным и неизменным,
+    // прежде чем писатель считается упавшим посреди публикации
+    static constexpr chrono::milliseconds kWriterStallTimeout{ 2000 };
+
+    // отобразить заново, если писатель увеличил сегмент
+    void remapIfGrown() {
+        size_t capacity = static_cast<size_t>(header()->capacityBytes);
+        if (capacity > mappedSize) {
+            remap(capacity, PROT_READ);
+        }
+    }
+
+    // все столбцы, описанные заголовком, лежат внутри отображения
+    bool columnsFit(const SharedHotelHeader* h) const {
+        uint64_t n = h->roomCount;
+        return h->baseCostsOffset + n * sizeof(double) <= mappedSize &&
+            h->finalCostsOffset + n * sizeof(double) <= mappedSize &&
+            h->numberOffsetsOffset + (n + 1) * sizeof(uint32_t) <= mappedSize &&
+            h->numberDataOffset <= mappedSize;
+    }
+
+    // выполнить чтение body по согласованному состоянию сегмента
+    template <typename Body>
+    void readConsistent(Body body) {
+        uint64_t stalledAt = 0;
+        chrono::steady_clock::time_point stalledSince;
+        while (true) {
+            uint64_t before = header()->sequence.load(memory_order_acquire);
+            if (before & 1) {
+                chrono::steady_clock::time_point now = chrono::steady_clock::now();
+                if (before != stalledAt) {
+                    stalledAt = before;
+                    stalledSince = now;
+                }
+                else if (now - stalledSince > kWriterStallTimeout) {
+                    throw HotelException("писатель сегмента '" + name + "' завис посреди публикации");
+                }
+                this_thread::yield();
+                continue;
+            }
+            remapIfGrown();
+            const SharedHotelHeader* h = header();
+            bool fits = columnsFit(h);
+            if (fits) {
+                body(h);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (header()->sequence.load(memory_order_relaxed) == before && fits) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit SharedHotelReader(const string& name_)
+        : SharedHotelSegment(name_)
+    {
+        fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw HotelException("сегмент '" + name + "' не найден");
+        }
+        map(sizeof(SharedHotelHeader), PROT_READ);
+        if (header()->magic != kSharedHotelMagic || header()->formatVersion != 1) {
+            throw HotelException("сегмент '" + name + "' имеет неверный формат");
+        }
+        remapIfGrown();
+    }
+
+    double calculateAverageCost() {
+        double sum = 0.0;
+        uint64_t count = 0;
+        readConsistent([&](const SharedHotelHeader* h) {
+            const double* finalCosts = reinterpret_cast<const double*>(base + h->finalCostsOffset);
+            count = h->roomCount;
+            sum = 0.0;
+            for (uint64_t i = 0; i < count; ++i) sum += finalCosts[i];
+        });
+        if (count == 0) {
+            throw EmptyRoomListException("нечего усреднять");
+        }
+        return sum / static_cast<double>(count);
+    }
+
+    vector<SnapshotRow> rows() {
+        vector<SnapshotRow> result;
+        readConsistent([&](const SharedHotelHeader* h) {
+            const double* baseCosts = reinterpret_cast<const double*>(base + h->baseCostsOffset);
+            const double* finalCosts = reinterpret_cast<const double*>(base + h->finalCostsOffset);
+            const uint32_t* offsets = reinterpret_cast<const uint32_t*>(base + h->numberOffsetsOffset);
+            const char* data = reinterpret_cast<const char*>(base + h->numberDataOffset);
+            size_t dataSize = mappedSize - static_cast<size_t>(h->numberDataOffset);
+            result.clear();
+            for (uint64_t i = 0; i < h->roomCount; ++i) {
+                uint32_t from = offsets[i];
+                uint32_t to = offsets[i + 1];
+                if (from > to || to > dataSize) break;   // повтор по seqlock
+                result.push_back({ string(data + from, to - from), baseCosts[i], finalCosts[i] });
+            }
+        });
+        return result;
+    }
+};
+
+int runSharedReader(const string& segmentName) {
+    SharedHotelReader reader(segmentName);
+
+    while (true) {
+        cout << "\n===== РАЗДЕЛЯЕМАЯ ПАМЯТЬ (только чтение) =====\n";
+        cout << "1. Показать все номера\n";
+        cout << "2. Вычислить среднюю стоимость проживания (с учётом скидок)\n";
+        cout << "0. Выход\n";
+        cout << "==============================================\n";
+
+        int choice = inputMenuChoice("Ваш выбор: ", 0, 2);
+
+        try {
+            if (choice == 0) {
+                break;
+            }
+            else if (choice == 1) {
+                vector<SnapshotRow> rows = reader.rows();
+                if (rows.empty()) {
+                    cout << "Список номеров пуст.\n";
+                    continue;
+                }
+                cout << left << setw(12) << "Номер" << setw(14) << "Баз.стоимость" << setw(16) << "После скидки" << '\n';
+                for (const SnapshotRow& r : rows) {
+                    cout << left << setw(12) << r.number
+                        << setw(14) << fixed << setprecision(2) << r.baseCost
+                        << setw(16) << fixed << setprecision(2) << r.finalCost
+                        << '\n';
+                }
+            }
+            else if (choice == 2) {
+                double avg = reader.calculateAverageCost();
+                cout << fixed << setprecision(2);
+                cout << "Средняя стоимость проживания (после скидок): " << avg << '\n';
+            }
+        }
+        catch (const HotelException& ex) {
+            cout << "Ошибка: " << ex.what() << '\n';
+        }
+    }
+    return 0;
+}
+
+#endif
+
+// ------------------- Замер вставки -------------------
+
+// Время и число выделений памяти на одну вставку для разных перегрузок addRoom
+int runInsertBenchmark(size_t count) {
+    struct KeySet {
+        const char* title;
+        vector<string> numbers;
+    };
+    KeySet keySets[2];
+    keySets[0].title = "числовые номера";
+    keySets[1].title = "длинные номера ";
+    for (size_t i = 0; i < count; ++i) {
+        keySets[0].numbers.push_back(to_string(100 + i));
+        keySets[1].numbers.push_back("Корпус-Б-этаж-" + to_string(i / 100) + "-номер-" + to_string(i));
+    }
+
+    if (!allocationCountingEnabled()) {
+        cout << "Подсчёт выделений выключен (соберите с -DHOTEL_COUNT_ALLOCATIONS)\n";
+    }
+    for (const KeySet& keys : keySets) {
+        for (int variant = 0; variant < 4; ++variant) {
+            vector<string> numbers = keys.numbers;   // копия: перемещающие варианты её опустошают
+            Hotel hotel;
+            hotel.reserve(count);
+
+            size_t allocationsBefore = allocationCount();
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                switch (variant) {
+                case 0: hotel.addRoom(numbers[i], 1000.0, 10.0); break;
+                case 1: hotel.addRoom(move(numbers[i]), 1000.0, 10.0); break;
+                case 2: hotel.addRoom(string_view(numbers[i]), 1000.0, 10.0); break;
+                default: hotel.emplaceRoom(move(numbers[i]), 1000.0, makeDiscountStrategy(10.0)); break;
+                }
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            size_t allocations = allocationCount() - allocationsBefore;
+
+            static const char* const names[] = { "const string&", "string&&     ", "string_view  ", "emplaceRoom  " };
+            cout << keys.title << "  " << names[variant] << "  "
+                << fixed << setprecision(1) << seconds * 1e9 / static_cast<double>(count) << " нс/вставку";
+            if (allocationCountingEnabled()) {
+                cout << ", " << setprecision(2) << static_cast<double>(allocations) / static_cast<double>(count) << " выделений/вставку";
+            }
+            cout << '\n';
+        }
+    }
+    return 0;
+}
+
+// ------------------- Замер импорта -------------------
+
+// Импорт incoming номеров (каждый десятый уже есть) в гостиницу из existing
+// номеров с длинными обозначениями: с фильтром Блума и без него
+int runImportBenchmark(size_t existing, size_t incoming) {
+    auto numberOf = [](size_t i) { return "Корпус-" + to_string(i % 7) + "-номер-" + to_string(i); };
+    string data;
+    for (size_t i = 0; i < incoming; ++i) {
+        size_t id = i % 10 == 0 ? (i * 7919) % max<size_t>(existing, 1) : existing + i;
+        data += numberOf(id) + " 1500 10\n";
+    }
+
+    cout << "В гостинице: " << existing << ", импортируется: " << incoming << '\n';
+    for (int useFilter = 0; useFilter < 2; ++useFilter) {
+        Hotel hotel;
+        hotel.reserve(existing + incoming);
+        for (size_t i = 0; i < existing; ++i) hotel.emplaceRoom(numberOf(i), 1000.0, makeDiscountStrategy(0.0));
+
+        istringstream in(data);
+        auto start = chrono::steady_clock::now();
+        ImportReport report = hotel.importRooms(in, useFilter != 0);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << (useFilter ? "с фильтром Блума: " : "без фильтра:      ")
+            << fixed << setprecision(1) << seconds * 1e9 / static_cast<double>(max<size_t>(incoming, 1)) << " нс/строку, добавлено "
+            << report.added << ", повторов " << report.duplicates << ", отсеяно фильтром " << report.filterNegatives << '\n';
+
+        if (!useFilter) continue;
+        // отдельно - только проверка новых обозначений
+        vector<string> fresh;
+        for (size_t i = 0; i < incoming; ++i) fresh.push_back(numberOf(existing + incoming + i));
+        size_t found = 0;
+        auto lookupStart = chrono::steady_clock::now();
+        for (const string& number : fresh) found += hotel.hasRoom(number);
+        auto filterStart = chrono::steady_clock::now();
+        for (const string& number : fresh) found += hotel.mayHaveRoom(number);
+        auto filterEnd = chrono::steady_clock::now();
+        cout << "проверка нового номера: индекс "
+            << chrono::duration<double, nano>(filterStart - lookupStart).count() / static_cast<double>(max<size_t>(incoming, 1))
+            << " нс, фильтр "
+            << chrono::duration<double, nano>(filterEnd - filterStart).count() / static_cast<double>(max<size_t>(incoming, 1))
+            << " нс (ложных срабатываний " << found << ")\n";
+    }
+    return 0;
+}
+
+// ------------------- Режим последователя -------------------
+
+#ifndef _WIN32
+int runFollower(const string& socketPath) {
+    ReplicationFollower follower(socketPath);
+
+    while (true) {
+        cout << "\n===== РЕПЛИКА (только чтение) =====\n";
+        cout << "1. Показать все номера\n";
+        cout << "2. Вычислить среднюю стоимость проживания (с учётом скидок)\n";
+        cout << "3. Показать отставание репликации\n";
+        cout << "4. Выполнить запрос\n";
+        cout << "0. Выход\n";
+        cout << "===================================\n";
+
+        int choice = inputMenuChoice("Ваш выбор: ", 0, 4);
+
+        try {
+            if (choice == 0) {
+                break;
+            }
+            else if (choice == 1) {
+                follower.printAll();
+            }
+            else if (choice == 2) {
+                double avg = follower.calculateAverageCost();
+                cout << fixed << setprecision(2);
+                cout << "Средняя стоимость проживания (после скидок): " << avg << '\n';
+            }
+            else if (choice == 3) {
+                follower.printLag();
+            }
+            else if (choice == 4) {
+                follower.query(inputNonEmptyString("Запрос: "), cout);
+            }
+        }
+        catch (const HotelException& ex) {
+            cout << "Ошибка: " << ex.what() << '\n';
+        }
+    }
+    return 0;
+}
+#endif
+
 // ------------------- main -------------------
 
-int main() {
+// число из аргумента командной строки замеров
+size_t parseCountArgument(const char* text) {
+    const char* end = text + strlen(text);
+    unsigned long long value = 0;
+    auto parsed = from_chars(text, end, value);
+    if (parsed.ec != errc() || parsed.ptr != end || value == 0) {
+        throw InvalidValueException(string("ожидалось положительное целое число, получено '") + text + "'");
+    }
+    return static_cast<size_t>(value);
+}
+
+int main(int argc, char* argv[]) {
 #ifdef _WIN32
     SetConsoleCP(1251);
     SetConsoleOutputCP(1251);
 #endif
     setlocale(LC_ALL, "Russian");
 
+    if (argc >= 3 && string(argv[1]) == "--follower") {
+#ifndef _WIN32
+        try {
+            return runFollower(argv[2]);
+        }
+        catch (const HotelException& ex) {
+            cout << "Ошибка: " << ex.what() << '\n';
+            return 1;
+        }
+#else
+        cout << "Репликация доступна только в POSIX-системах.\n";
+        return 1;
+#endif
+    }
+    if (argc >= 3 && string(argv[1]) == "--bench") {
+        string bench = argv[2];
+        try {
+            if (bench == "numa") {
+                size_t properties = argc >= 4 ? parseCountArgument(argv[3]) : 64;
+                size_t roomsPerProperty = argc >= 5 ? parseCountArgument(argv[4]) : 100000;
+                return runNumaBenchmark(properties, roomsPerProperty);
+            }
+            if (bench == "import") {
+                size_t existing = argc >= 4 ? parseCountArgument(argv[3]) : 2000000;
+                size_t incoming = argc >= 5 ? parseCountArgument(argv[4]) : 1000000;
+                return runImportBenchmark(existing, incoming);
+            }
+            if (bench == "insert") {
+                return runInsertBenchmark(argc >= 4 ? parseCountArgument(argv[3]) : 200000);
+            }
+        }
+        catch (const HotelException& ex) {
+            cout << "Ошибка: " << ex.what() << '\n';
+        }
+        cout << "Использование:\n"
+            << "  --bench numa [гостиниц] [номеров в гостинице]\n"
+            << "  --bench import [номеров в гостинице] [номеров в файле]\n"
+            << "  --bench insert [номеров]\n";
+        return 1;
+    }
+    if (argc >= 3 && string(argv[1]) == "--shm-reader") {
+#ifndef _WIN32
+        try {
+            return runSharedReader(argv[2]);
+        }
+        catch (const HotelException& ex) {
+            cout << "Ошибка: " << ex.what() << '\n';
+            return 1;
+        }
+#else
+        cout << "Разделяемая память доступна только в POSIX-системах.\n";
+        return 1;
+#endif
+    }
+
+    if (argc >= 4 && string(argv[1]) == "--query") {
+        // разовый запрос к снимку: --query <файл снимка> "<запрос>"
+        try {
+            Hotel snapshot;
+            snapshot.loadSnapshot(string(argv[2]));
+            executeQueryCommand(snapshot, argv[3], cout);
+            return 0;
+        }
+        catch (const HotelException& ex) {
+            cout << "Ошибка: " << ex.what() << '\n';
+            return 1;
+        }
+    }
+
     Hotel hotel;
+    DiscountRuleTable rules;
+    CurrencyRateTable currencyRates;
+    HotelCurrencyView currencyView(hotel, currencyRates);
+    unique_ptr<ChangeLogFileWriter> changeLog;
+#ifndef _WIN32
+    unique_ptr<ReplicationLeader> replicationLeader;
+    unique_ptr<SharedHotelPublisher> sharedImage;
+#endif
 
     while (true) {
         cout << "\n===== МЕНЮ СИСТЕМЫ ГОСТИНИЦЫ =====\n";
         cout << "1. Добавить информацию о номере\n";
         cout << "2. Показать все номера\n";
         cout << "3. Вычислить среднюю стоимость проживания (с учётом скидок)\n";
+        cout << "4. Загрузить правила скидок из файла\n";
+        cout << "5. Добавить номер со скидкой по правилам\n";
+        cout << "6. Рассчитать цены по формуле партнёра\n";
+        cout << "7. Загрузить курсы валют из файла\n";
+        cout << "8. Показать цены в другой валюте\n";
+        cout << "9. Загрузить налоги и сборы из файла\n";
+        cout << "10. Изменить информацию о номере\n";
+        cout << "11. Удалить номер\n";
+        cout << "12. Записывать журнал изменений в файл\n";
+        cout << "13. Запустить репликацию (ведущий)\n";
+        cout << "14. Сохранить снимок в файл\n";
+        cout << "15. Загрузить снимок из файла\n";
+        cout << "16. Публиковать номера в разделяемую память\n";
+        cout << "17. Найти номера по диапазону стоимости\n";
+        cout << "18. Найти номера по началу обозначения\n";
+        cout << "19. Сформировать отчёт по гостинице\n";
+        cout << "20. Анализ эффективности скидок\n";
+        cout << "21. Групповая статистика по номерам\n";
+        cout << "22. Выполнить запрос (SELECT ... FROM rooms, EXPLAIN, PROFILE)\n";
+        cout << "23. Определить тип номера\n";
+        cout << "24. Добавить номер по типу\n";
+        cout << "25. Изменить цену типа номера\n";
+        cout << "26. Статистика по диапазону этажей или номеров\n";
+        cout << "27. Приближённая статистика цен (скетчи)\n";
+        cout << "28. Импортировать номера из файла\n";
+        cout << "29. Синхронизировать номера с полным файлом\n";
         cout << "0. Выход\n";
         cout << "===================================\n";
 
-        int choice = inputMenuChoice("Ваш выбор: ", 0, 3);
+        int choice = inputMenuChoice("Ваш выбор: ", 0, 29);
 
         try {
             if (choice == 0) {
@@ -325,7 +6324,7 @@ int main() {
                 string number = inputNonEmptyString("Введите обозначение номера (например 101, A-12): ");
                 double baseCost = inputPositiveDouble("Введите базовую стоимость за ночь: ");
                 double discount = inputNonNegativeDouble("Введите процент скидки на проживание (0 если нет, <100): ");
-                hotel.addRoom(number, baseCost, discount);
+                hotel.addRoom(move(number), baseCost, discount);
                 cout << "Информация о номере добавлена.\n";
             }
             else if (choice == 2) {
@@ -335,7 +6334,203 @@ int main() {
                 double avg = hotel.calculateAverageCost();
                 cout << fixed << setprecision(2);
                 cout << "Средняя стоимость проживания (после скидок): " << avg << '\n';
+                if (!hotel.getFeeSchedule().empty()) {
+                    cout << "Средняя стоимость проживания (с налогами и сборами): "
+                        << hotel.calculateAverageTotalCost() << '\n';
+                }
+            }
+            else if (choice == 4) {
+                string path = inputNonEmptyString("Введите путь к файлу правил: ");
+                rules = DiscountRuleTable::loadFromFile(path);
+                cout << "Загружено правил: " << rules.size() << '\n';
+            }
+            else if (choice == 5) {
+                string number = inputNonEmptyString("Введите обозначение номера (например 101, A-12): ");
+                double baseCost = inputPositiveDouble("Введите базовую стоимость за ночь: ");
+                string roomType = inputNonEmptyString("Введите тип номера: ");
+                StayParams stay;
+                stay.nights = inputMenuChoice("Введите количество ночей: ", 1, 365);
+                stay.daysAhead = inputMenuChoice("За сколько дней до заезда бронирование: ", 0, 730);
+                hotel.addRoom(move(number), baseCost, rules.makeStrategy(roomType, stay));
+                cout << "Информация о номере добавлена.\n";
+            }
+            else if (choice == 6) {
+                string text = inputNonEmptyString("Введите формулу (например min(base * 0.9 + 200, 10000)): ");
+                PricingFormula formula(text);
+                hotel.printPrices(hotel.priceByFormula(formula), "По формуле");
+            }
+            else if (choice == 7) {
+                string path = inputNonEmptyString("Введите путь к файлу курсов: ");
+                currencyRates.loadFromFile(path);
+                cout << "Загружено курсов: " << currencyRates.size() << '\n';
+            }
+            else if (choice == 8) {
+                string currency = inputNonEmptyString("Введите код валюты (например EUR): ");
+                hotel.printPrices(currencyView.getFinalCosts(currency), "Итого, " + currency);
+            }
+            else if (choice == 9) {
+                string path = inputNonEmptyString("Введите путь к файлу сборов: ");
+                hotel.setFeeSchedule(FeeSchedule::loadFromFile(path));
+                cout << "Налоги и сборы загружены.\n";
+            }
+            else if (choice == 10) {
+                string number = inputNonEmptyString("Введите обозначение номера: ");
+                double baseCost = inputPositiveDouble("Введите новую базовую стоимость за ночь: ");
+                double discount = inputNonNegativeDouble("Введите новый процент скидки (0 если нет, <100): ");
+                hotel.updateRoom(number, baseCost, discount);
+                cout << "Информация о номере изменена.\n";
+            }
+            else if (choice == 11) {
+                string number = inputNonEmptyString("Введите обозначение номера: ");
+                hotel.removeRoom(number);
+                cout << "Номер удалён.\n";
+            }
+            else if (choice == 12) {
+                string path = inputNonEmptyString("Введите путь к файлу журнала: ");
+                changeLog.reset();
+                changeLog.reset(new ChangeLogFileWriter(hotel.getChangeStream(), path));
+                cout << "Журнал изменений записывается в " << path << '\n';
+            }
+            else if (choice == 13) {
+#ifndef _WIN32
+                string path = inputNonEmptyString("Введите путь Unix-сокета: ");
+                replicationLeader.reset();
+                replicationLeader.reset(new ReplicationLeader(hotel, path));
+                cout << "Последователи могут подключаться: --follower " << path << '\n';
+#else
+                cout << "Репликация доступна только в POSIX-системах.\n";
+#endif
+            }
+            else if (choice == 14) {
+                string path = inputNonEmptyString("Введите путь к файлу снимка: ");
+                hotel.saveSnapshot(path);
+                cout << "Снимок сохранён.\n";
+            }
+            else if (choice == 15) {
+                string path = inputNonEmptyString("Введите путь к файлу снимка: ");
+                hotel.loadSnapshot(path);
+                cout << "Снимок загружен.\n";
+            }
+            else if (choice == 16) {
+#ifndef _WIN32
+                string name = inputNonEmptyString("Введите имя сегмента (например /hotel): ");
+                sharedImage.reset();
+                sharedImage.reset(new SharedHotelPublisher(name));
+                cout << "Читатели могут подключаться: --shm-reader " << name << '\n';
+#else
+                cout << "Разделяемая память доступна только в POSIX-системах.\n";
+#endif
+            }
+            else if (choice == 17) {
+                double low = inputNonNegativeCost("Введите минимальную стоимость: ");
+                double high = inputNonNegativeCost("Введите максимальную стоимость: ");
+                hotel.printRooms(hotel.findByCostRange(low, high));
             }
+            else if (choice == 18) {
+                string prefix = inputNonEmptyString("Введите начало обозначения номера: ");
+                hotel.printRooms(hotel.findByPrefix(prefix));
+            }
+            else if (choice == 19) {
+                HotelReport report = hotel.buildReport();
+                int format = inputMenuChoice("Формат отчёта (1 - текст, 2 - HTML): ", 1, 2);
+                if (format == 1) {
+                    renderReportText(report, cout);
+                }
+                else {
+                    string path = inputNonEmptyString("Введите путь к HTML-файлу: ");
+                    ofstream out(path);
+                    if (!out) {
+                        throw HotelException("не удалось открыть файл отчёта '" + path + "'");
+                    }
+                    renderReportHtml(report, out);
+                    cout << "Отчёт сохранён в " << path << '\n';
+                }
+            }
+            else if (choice == 20) {
+                printDiscountAnalytics(hotel.analyzeDiscounts());
+            }
+            else if (choice == 21) {
+                int dimension = inputMenuChoice("Группировать по (1 - этажу, 2 - уровню скидки, 3 - стратегии, 4 - типу): ", 1, 4);
+                int column = inputMenuChoice("Столбец (1 - базовая, 2 - после скидки, 3 - с налогами): ", 1, 3);
+                static const GroupDimension dimensions[] = { GroupDimension::Floor, GroupDimension::DiscountTier,
+                                                             GroupDimension::Strategy, GroupDimension::RoomType };
+                static const ValueColumn columns[] = { ValueColumn::BaseCost, ValueColumn::FinalCost, ValueColumn::TotalCost };
+                printGroupStats(hotel.groupBy(dimensions[dimension - 1], columns[column - 1]));
+            }
+            else if (choice == 22) {
+                executeQueryCommand(hotel, inputNonEmptyString("Запрос: "), cout);
+            }
+            else if (choice == 23) {
+                string name = inputNonEmptyString("Введите название типа: ");
+                double base = inputPositiveDouble("Введите базовую стоимость типа: ");
+                double discount = inputNonNegativeDouble("Введите скидку типа (в процентах): ");
+                hotel.defineRoomType(name, base, discount);
+                hotel.printRoomTypes();
+            }
+            else if (choice == 24) {
+                string number = inputNonEmptyString("Введите номер комнаты: ");
+                string type = inputNonEmptyString("Введите тип номера: ");
+                if (inputMenuChoice("Цена (1 - как у типа, 2 - своя): ", 1, 2) == 1) {
+                    hotel.addRoomOfType(number, type);
+                }
+                else {
+                    double base = inputPositiveDouble("Введите базовую стоимость: ");
+                    double discount = inputNonNegativeDouble("Введите скидку (в процентах): ");
+                    hotel.addRoomOfType(number, type, base, discount);
+                }
+                cout << "Номер добавлен.\n";
+            }
+            else if (choice == 25) {
+                string type = inputNonEmptyString("Введите тип номера: ");
+                double base = inputPositiveDouble("Введите новую базовую стоимость типа: ");
+                double discount = inputNonNegativeDouble("Введите новую скидку типа (в процентах): ");
+                hotel.repriceRoomType(type, base, discount);
+                hotel.printRoomTypes();
+            }
+            else if (choice == 26) {
+                GroupStats range;
+                if (inputMenuChoice("Диапазон (1 - этажей, 2 - обозначений): ", 1, 2) == 1) {
+                    int fromFloor = inputMenuChoice("Первый этаж: ", 0, 1000000);
+                    int toFloor = inputMenuChoice("Последний этаж: ", fromFloor, 1000000);
+                    range = { "этажи " + to_string(fromFloor) + "-" + to_string(toFloor), hotel.rangeStatsByFloor(fromFloor, toFloor) };
+                }
+                else {
+                    string from = inputNonEmptyString("Первый номер: ");
+                    string to = inputNonEmptyString("Последний номер: ");
+                    range = { "номера " + from + "-" + to, hotel.rangeStatsByNumber(from, to) };
+                }
+                printGroupStats({ range });
+            }
+            else if (choice == 27) {
+                printHotelSketches(hotel.getSketches());
+            }
+            else if (choice == 28) {
+                string path = inputNonEmptyString("Введите путь к файлу импорта: ");
+                ImportReport report = hotel.importRooms(path);
+                cout << "Добавлено номеров: " << report.added << ", пропущено повторов: " << report.duplicates << '\n';
+            }
+            else if (choice == 29) {
+                string path = inputNonEmptyString("Введите путь к полному файлу номеров (последняя строка '# end <число номеров>'): ");
+                DiffImportReport report;
+                try {
+                    report = hotel.importDiff(path);
+                }
+                catch (const MassRemovalException& ex) {
+                    cout << ex.what() << '\n';
+                    if (inputMenuChoice("Удалить их? (1 - да, 2 - нет): ", 1, 2) != 1) {
+                        cout << "Синхронизация отменена, номера не изменены.\n";
+                        continue;
+                    }
+                    report = hotel.importDiff(path, true);
+                }
+                cout << "Добавлено: " << report.added << ", изменено: " << report.updated
+                    << ", удалено: " << report.removed << ", без изменений: " << report.unchanged << '\n';
+            }
+#ifndef _WIN32
+            if (sharedImage) {
+                sharedImage->publish(hotel);
+            }
+#endif
         }
         catch (const HotelException& ex) {
             cout << "Ошибка: " << ex.what() << '\n';
@@ -343,6 +6538,11 @@ int main() {
         catch (const exception& ex) {
             cout << "Непредвиденная ошибка: " << ex.what() << '\n';
         }
+#ifndef _WIN32
+        if (replicationLeader) {
+            replicationLeader->resyncIfNeeded(hotel);
+        }
+#endif
     }
 
     return 0;